@@ -14,7 +14,9 @@
 #ifndef LLVM_ANALYSIS_INLINECOST_H
 #define LLVM_ANALYSIS_INLINECOST_H
 
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/Analysis/CallGraphSCCPass.h"
+#include "llvm/IR/ValueMap.h"
 #include <cassert>
 #include <climits>
 
@@ -98,11 +100,60 @@ public:
   int getCostDelta() const { return Threshold - getCost(); }
 };
 
+/// \brief A summary of the inline cost of a callee's body.
+///
+/// This captures everything the cost analysis learns from walking the callee
+/// when the call site provides no constant, alloca-derived or otherwise
+/// simplifiable arguments. Such call sites all see the same body cost, so the
+/// summary can be computed once per callee and combined with the cheap
+/// per-call-site adjustments for every further call site.
+struct InlineCostSummary {
+  /// The accumulated cost of the callee's body.
+  int Cost;
+
+  /// True if the walk stopped early because \c Cost crossed the cap the
+  /// summary was built with. \c Cost is then a lower bound on the real cost.
+  bool IsTruncated;
+
+  /// False if the body contains something which can never be inlined.
+  bool IsViable;
+
+  /// True if the body has no conditional control flow.
+  bool IsSingleBB;
+
+  bool ContainsNoDuplicateCall;
+
+  /// Number of bytes allocated statically by the callee.
+  uint64_t AllocatedSize;
+  unsigned NumInstructions, NumVectorInstructions;
+
+  InlineCostSummary()
+      : Cost(0), IsTruncated(false), IsViable(true), IsSingleBB(true),
+        ContainsNoDuplicateCall(false), AllocatedSize(0), NumInstructions(0),
+        NumVectorInstructions(0) {}
+};
+
 /// \brief Cost analyzer used by inliner.
 class InlineCostAnalysis : public CallGraphSCCPass {
   TargetTransformInfoWrapperPass *TTIWP;
   AssumptionCacheTracker *ACT;
 
+  /// Don't follow RAUW of a callee; a replaced function has a new body.
+  struct SummaryMapConfig : ValueMapConfig<const Function *> {
+    enum { FollowRAUW = false };
+  };
+
+  /// Cached body cost summaries, keyed by callee. Entries for deleted
+  /// functions are dropped automatically by the value map.
+  ValueMap<const Function *, InlineCostSummary, SummaryMapConfig> Summaries;
+
+  /// The functions of the SCC currently being visited. These are mutated by
+  /// the inliner and the function passes which follow it, so their
+  /// summaries are never cached.
+  SmallPtrSet<const Function *, 8> SCCFunctions;
+
+  const InlineCostSummary *getSummary(CallSite CS, Function &Callee);
+
 public:
   static char ID;
 
@@ -111,7 +162,11 @@ public:
 
   // Pass interface implementation.
   void getAnalysisUsage(AnalysisUsage &AU) const override;
+  using llvm::Pass::doInitialization;
+  using llvm::Pass::doFinalization;
+  bool doInitialization(CallGraph &CG) override;
   bool runOnSCC(CallGraphSCC &SCC) override;
+  bool doFinalization(CallGraph &CG) override;
 
   /// \brief Get an InlineCost object representing the cost of inlining this
   /// callsite.
@@ -134,6 +189,12 @@ public:
   //  adding a replacement API.
   InlineCost getInlineCost(CallSite CS, Function *Callee, int Threshold);
 
+  /// \brief Drop any cached cost summary of \p Callee.
+  ///
+  /// Passes which modify a function outside of the SCC being visited must
+  /// call this before the next inline cost query involving it.
+  void forgetCallee(const Function &Callee) { Summaries.erase(&Callee); }
+
   /// \brief Minimal filter to detect invalid constructs for inlining.
   bool isInlineViable(Function &Callee);
 };
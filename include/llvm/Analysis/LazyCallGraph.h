@@ -414,6 +414,19 @@ public:
                                                   postorder_scc_end());
   }
 
+  /// \brief Partition the SCC DAG into wavefronts of independent SCCs.
+  ///
+  /// This forms every SCC in the graph and places each one in the wavefront
+  /// just past the deepest of its child SCCs, so the leaf SCCs make up the
+  /// first wavefront. No two SCCs in a wavefront have a caller/callee
+  /// relationship, and every SCC a wavefront calls lives in an earlier one.
+  /// Thus once the earlier wavefronts are processed, all of the SCCs in the
+  /// next one are ready and can be handed out in any order (or concurrently
+  /// by a client which can do so safely) without changing the bottom-up
+  /// guarantees of a postorder walk. Within a wavefront the SCCs are kept in
+  /// postorder so the partition is deterministic.
+  void buildSCCWavefronts(SmallVectorImpl<SmallVector<SCC *, 4>> &Wavefronts);
+
   /// \brief Lookup a function in the graph which has already been scanned and
   /// added.
   Node *lookup(const Function &F) const { return NodeMap.lookup(&F); }
@@ -597,6 +597,10 @@ public:
   /// the analysis.
   const LoopAccessInfo &getInfo(Loop *L, const ValueToValueMap &Strides);
 
+  /// \brief Drop the cached result for \p L after a transformation changed
+  /// the loop, so that the next query analyzes it again.
+  void forgetLoop(Loop *L) { LoopAccessInfoMap.erase(L); }
+
   void releaseMemory() override {
     // Invalidate the cache when the pass is freed.
     LoopAccessInfoMap.clear();
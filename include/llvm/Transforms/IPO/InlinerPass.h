@@ -42,6 +42,11 @@ struct Inliner : public CallGraphSCCPass {
   // Pass class.
   bool runOnSCC(CallGraphSCC &SCC) override;
 
+  using llvm::Pass::doInitialization;
+  // doInitialization - Find the hottest function entry count in the module so
+  // that the profile, if any, can be used to classify call sites.
+  bool doInitialization(CallGraph &CG) override;
+
   using llvm::Pass::doFinalization;
   // doFinalization - Remove now-dead linkonce functions at the end of
   // processing to avoid breaking the SCC traversal.
@@ -55,7 +60,8 @@ struct Inliner : public CallGraphSCCPass {
   /// Calculate the inline threshold for given Caller. This threshold is lower
   /// if the caller is marked with OptimizeForSize and -inline-threshold is not
   /// given on the comand line. It is higher if the callee is marked with the
-  /// inlinehint attribute.
+  /// inlinehint attribute or is hot according to the profile, and lower if it
+  /// is cold.
   ///
   unsigned getInlineThreshold(CallSite CS) const;
 
@@ -74,10 +80,21 @@ struct Inliner : public CallGraphSCCPass {
   /// deal with that subset of the functions.
   bool removeDeadFunctions(CallGraph &CG, bool AlwaysInlineOnly = false);
 
+  /// How an instrumentation profile classifies the callee of a call site.
+  enum ProfileHotness { PH_Unknown, PH_Hot, PH_Neutral, PH_Cold };
+
+  /// getProfileHotness - Classify the callee of CS by comparing its function
+  /// entry count with the hottest one in the module.
+  ProfileHotness getProfileHotness(CallSite CS) const;
+
 private:
   // InlineThreshold - Cache the value here for easy access.
   unsigned InlineThreshold;
 
+  // MaxFunctionEntryCount - The hottest function entry count in the module, or
+  // zero if the module has no profile.
+  uint64_t MaxFunctionEntryCount;
+
   // InsertLifetime - Insert @llvm.lifetime intrinsics.
   bool InsertLifetime;
 
@@ -486,6 +486,12 @@ FunctionPass *createNaryReassociatePass();
 //
 FunctionPass *createLoopDistributePass();
 
+//===----------------------------------------------------------------------===//
+//
+// LoopFuse - Fuse adjacent loops with equal trip counts.
+//
+FunctionPass *createLoopFusePass();
+
 } // End llvm namespace
 
 #endif
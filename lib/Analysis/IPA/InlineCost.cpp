@@ -18,10 +18,12 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/CallGraph.h"
 #include "llvm/Analysis/CodeMetrics.h"
 #include "llvm/Analysis/ConstantFolding.h"
 #include "llvm/Analysis/InstructionSimplify.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/CallingConv.h"
 #include "llvm/IR/DataLayout.h"
@@ -30,6 +32,7 @@
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Operator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -38,6 +41,19 @@ using namespace llvm;
 #define DEBUG_TYPE "inline-cost"
 
 STATISTIC(NumCallsAnalyzed, "Number of call sites analyzed");
+STATISTIC(NumSummariesComputed, "Number of callee cost summaries computed");
+STATISTIC(NumSummariesReused, "Number of call sites analyzed from a summary");
+
+static cl::opt<bool>
+UseCostSummaries("inline-cost-summaries", cl::Hidden, cl::init(true),
+                 cl::desc("Cache per-callee inline cost summaries and reuse "
+                          "them for call sites with no simplifiable "
+                          "arguments"));
+
+static cl::opt<int>
+SummaryCostCap("inline-cost-summary-cap", cl::Hidden, cl::init(5000),
+               cl::desc("Stop walking a callee body for its cost summary "
+                        "once the cost exceeds this value"));
 
 namespace {
 
@@ -56,7 +72,8 @@ class CallAnalyzer : public InstVisitor<CallAnalyzer, bool> {
 
   // The candidate callsite being analyzed. Please do not use this to do
   // analysis in the caller function; we want the inline cost query to be
-  // easily cacheable. Instead, use the cover function paramHasAttr.
+  // easily cacheable. Instead, use the cover function paramHasAttr. This is
+  // null when computing a call-site independent summary of the callee.
   CallSite CandidateCS;
 
   int Threshold;
@@ -77,6 +94,11 @@ class CallAnalyzer : public InstVisitor<CallAnalyzer, bool> {
   int FiftyPercentVectorBonus, TenPercentVectorBonus;
   int VectorBonus;
 
+  // The threshold bonus for a callee with no conditional control flow, and
+  // whether the walk has found any yet.
+  int SingleBBBonus;
+  bool SingleBB;
+
   // While we walk the potentially-inlined instructions, we build up and
   // maintain a mapping of simplified values specific to this callsite. The
   // idea is to propagate any special information we have about arguments to
@@ -124,6 +146,8 @@ class CallAnalyzer : public InstVisitor<CallAnalyzer, bool> {
 
   // Custom analysis routines.
   bool analyzeBlock(BasicBlock *BB, SmallPtrSetImpl<const Value *> &EphValues);
+  bool analyzeBody();
+  bool applySummary(const InlineCostSummary &Summary);
 
   // Disable several entry points to the visitor so we don't accidentally use
   // them by declaring but not defining them here.
@@ -167,12 +191,14 @@ public:
         ContainsNoDuplicateCall(false), HasReturn(false), HasIndirectBr(false),
         HasFrameEscape(false), AllocatedSize(0), NumInstructions(0),
         NumVectorInstructions(0), FiftyPercentVectorBonus(0),
-        TenPercentVectorBonus(0), VectorBonus(0), NumConstantArgs(0),
+        TenPercentVectorBonus(0), VectorBonus(0), SingleBBBonus(0),
+        SingleBB(true), NumConstantArgs(0),
         NumConstantOffsetPtrArgs(0), NumAllocaArgs(0), NumConstantPtrCmps(0),
         NumConstantPtrDiffs(0), NumInstructionsSimplified(0),
         SROACostSavings(0), SROACostSavingsLost(0) {}
 
-  bool analyzeCall(CallSite CS);
+  bool analyzeCall(CallSite CS, const InlineCostSummary *Summary = nullptr);
+  void computeSummary(InlineCostSummary &Summary);
 
   int getThreshold() { return Threshold; }
   int getCost() { return Cost; }
@@ -514,6 +540,8 @@ bool CallAnalyzer::visitUnaryInstruction(UnaryInstruction &I) {
 
 bool CallAnalyzer::paramHasAttr(Argument *A, Attribute::AttrKind Attr) {
   unsigned ArgNo = A->getArgNo();
+  if (!CandidateCS)
+    return F.getAttributes().hasAttribute(ArgNo+1, Attr);
   return CandidateCS.paramHasAttr(ArgNo+1, Attr);
 }
 
@@ -1048,8 +1076,11 @@ ConstantInt *CallAnalyzer::stripAndComputeInBoundsConstantOffsets(Value *&V) {
 /// viable. It computes the cost and adjusts the threshold based on numerous
 /// factors and heuristics. If this method returns false but the computed cost
 /// is below the computed threshold, then inlining was forcibly disabled by
-/// some artifact of the routine.
-bool CallAnalyzer::analyzeCall(CallSite CS) {
+/// some artifact of the routine. If \p Summary is provided, it is used in
+/// place of walking the callee body; the call site must then have no
+/// arguments the walk could have taken advantage of.
+bool CallAnalyzer::analyzeCall(CallSite CS,
+                               const InlineCostSummary *Summary) {
   ++NumCallsAnalyzed;
 
   // Perform some tweaks to the cost and threshold based on the direct
@@ -1071,8 +1102,7 @@ bool CallAnalyzer::analyzeCall(CallSite CS) {
   // Track whether the post-inlining function would have more than one basic
   // block. A single basic block is often intended for inlining. Balloon the
   // threshold by 50% until we pass the single-BB phase.
-  bool SingleBB = true;
-  int SingleBBBonus = Threshold / 2;
+  SingleBBBonus = Threshold / 2;
 
   // Speculatively apply all possible bonuses to Threshold. If cost exceeds
   // this Threshold any time, and cost cannot decrease, we can stop processing
@@ -1150,30 +1180,68 @@ bool CallAnalyzer::analyzeCall(CallSite CS) {
     }
   }
 
-  // Populate our simplified values by mapping from function arguments to call
-  // arguments with known important simplifications.
-  CallSite::arg_iterator CAI = CS.arg_begin();
-  for (Function::arg_iterator FAI = F.arg_begin(), FAE = F.arg_end();
-       FAI != FAE; ++FAI, ++CAI) {
-    assert(CAI != CS.arg_end());
-    if (Constant *C = dyn_cast<Constant>(CAI))
-      SimplifiedValues[FAI] = C;
-
-    Value *PtrArg = *CAI;
-    if (ConstantInt *C = stripAndComputeInBoundsConstantOffsets(PtrArg)) {
-      ConstantOffsetPtrs[FAI] = std::make_pair(PtrArg, C->getValue());
-
-      // We can SROA any pointer arguments derived from alloca instructions.
-      if (isa<AllocaInst>(PtrArg)) {
-        SROAArgValues[FAI] = PtrArg;
-        SROAArgCosts[PtrArg] = 0;
+  // A truncated summary only bounds the cost from below. That is enough to
+  // reject the call site if the bound is already over the threshold, but
+  // otherwise we have to walk the body after all.
+  if (Summary && Summary->IsTruncated && Cost + Summary->Cost <= Threshold)
+    Summary = nullptr;
+
+  if (Summary) {
+    ++NumSummariesReused;
+    if (!applySummary(*Summary))
+      return false;
+  } else {
+    // Populate our simplified values by mapping from function arguments to
+    // call arguments with known important simplifications.
+    CallSite::arg_iterator CAI = CS.arg_begin();
+    for (Function::arg_iterator FAI = F.arg_begin(), FAE = F.arg_end();
+         FAI != FAE; ++FAI, ++CAI) {
+      assert(CAI != CS.arg_end());
+      if (Constant *C = dyn_cast<Constant>(CAI))
+        SimplifiedValues[FAI] = C;
+
+      Value *PtrArg = *CAI;
+      if (ConstantInt *C = stripAndComputeInBoundsConstantOffsets(PtrArg)) {
+        ConstantOffsetPtrs[FAI] = std::make_pair(PtrArg, C->getValue());
+
+        // We can SROA any pointer arguments derived from alloca instructions.
+        if (isa<AllocaInst>(PtrArg)) {
+          SROAArgValues[FAI] = PtrArg;
+          SROAArgCosts[PtrArg] = 0;
+        }
       }
     }
+    NumConstantArgs = SimplifiedValues.size();
+    NumConstantOffsetPtrArgs = ConstantOffsetPtrs.size();
+    NumAllocaArgs = SROAArgValues.size();
+
+    if (!analyzeBody())
+      return false;
   }
-  NumConstantArgs = SimplifiedValues.size();
-  NumConstantOffsetPtrArgs = ConstantOffsetPtrs.size();
-  NumAllocaArgs = SROAArgValues.size();
 
+  // If this is a noduplicate call, we can still inline as long as
+  // inlining this would cause the removal of the caller (so the instruction
+  // is not actually duplicated, just moved).
+  if (!OnlyOneCallAndLocalLinkage && ContainsNoDuplicateCall)
+    return false;
+
+  // We applied the maximum possible vector bonus at the beginning. Now,
+  // subtract the excess bonus, if any, from the Threshold before
+  // comparing against Cost.
+  if (NumVectorInstructions <= NumInstructions / 10)
+    Threshold -= FiftyPercentVectorBonus;
+  else if (NumVectorInstructions <= NumInstructions / 2)
+    Threshold -= (FiftyPercentVectorBonus - TenPercentVectorBonus);
+
+  return Cost < Threshold;
+}
+
+/// \brief Walk the live blocks of the callee accumulating their cost.
+///
+/// Returns false if inlining is not viable because of some construct in the
+/// body, and true otherwise. The walk stops early once the cost crosses the
+/// threshold, in which case the cost is only a lower bound.
+bool CallAnalyzer::analyzeBody() {
   // FIXME: If a caller has multiple calls to a callee, we end up recomputing
   // the ephemeral values multiple times (and they're completely determined by
   // the callee, so this is purely duplicate work).
@@ -1225,7 +1293,7 @@ bool CallAnalyzer::analyzeCall(CallSite CS) {
           AllocatedSize > InlineConstants::TotalAllocaSizeRecursiveCaller)
         return false;
 
-      break;
+      return true;
     }
 
     TerminatorInst *TI = BB->getTerminator();
@@ -1267,21 +1335,49 @@ bool CallAnalyzer::analyzeCall(CallSite CS) {
     }
   }
 
-  // If this is a noduplicate call, we can still inline as long as
-  // inlining this would cause the removal of the caller (so the instruction
-  // is not actually duplicated, just moved).
-  if (!OnlyOneCallAndLocalLinkage && ContainsNoDuplicateCall)
+  return true;
+}
+
+/// \brief Account for the callee body using a precomputed summary instead of
+/// walking it. Returns false if inlining is not viable.
+bool CallAnalyzer::applySummary(const InlineCostSummary &Summary) {
+  if (!Summary.IsViable)
     return false;
 
-  // We applied the maximum possible vector bonus at the beginning. Now,
-  // subtract the excess bonus, if any, from the Threshold before
-  // comparing against Cost.
-  if (NumVectorInstructions <= NumInstructions / 10)
-    Threshold -= FiftyPercentVectorBonus;
-  else if (NumVectorInstructions <= NumInstructions / 2)
-    Threshold -= (FiftyPercentVectorBonus - TenPercentVectorBonus);
+  // The summary was built without knowledge of the caller, so apply the
+  // recursive caller stack limit here.
+  if (IsCallerRecursive &&
+      Summary.AllocatedSize > InlineConstants::TotalAllocaSizeRecursiveCaller)
+    return false;
 
-  return Cost < Threshold;
+  Cost += Summary.Cost;
+  AllocatedSize = Summary.AllocatedSize;
+  NumInstructions = Summary.NumInstructions;
+  NumVectorInstructions = Summary.NumVectorInstructions;
+  ContainsNoDuplicateCall = Summary.ContainsNoDuplicateCall;
+  if (!Summary.IsSingleBB) {
+    Threshold -= SingleBBBonus;
+    SingleBB = false;
+  }
+  return true;
+}
+
+/// \brief Compute the call-site independent cost summary of the callee.
+///
+/// The analyzer must have been built with a null call site and with the cap
+/// on the summary cost as its threshold.
+void CallAnalyzer::computeSummary(InlineCostSummary &Summary) {
+  assert(!CandidateCS && "Summaries must not depend on a call site!");
+  ++NumSummariesComputed;
+
+  Summary.IsViable = F.empty() || analyzeBody();
+  Summary.Cost = Cost;
+  Summary.IsTruncated = Cost > Threshold;
+  Summary.IsSingleBB = SingleBB;
+  Summary.ContainsNoDuplicateCall = ContainsNoDuplicateCall;
+  Summary.AllocatedSize = AllocatedSize;
+  Summary.NumInstructions = NumInstructions;
+  Summary.NumVectorInstructions = NumVectorInstructions;
 }
 
 #if !defined(NDEBUG) || defined(LLVM_ENABLE_DUMP)
@@ -1324,9 +1420,31 @@ void InlineCostAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
   CallGraphSCCPass::getAnalysisUsage(AU);
 }
 
+bool InlineCostAnalysis::doInitialization(CallGraph &CG) {
+  Summaries.clear();
+  return false;
+}
+
 bool InlineCostAnalysis::runOnSCC(CallGraphSCC &SCC) {
   TTIWP = &getAnalysis<TargetTransformInfoWrapperPass>();
   ACT = &getAnalysis<AssumptionCacheTracker>();
+
+  // The SCCs are visited bottom-up, so once a function's SCC is done with,
+  // nothing in this pass manager modifies its body again. The functions of
+  // the new SCC are about to be modified though, so drop any summaries built
+  // for them through a devirtualized call or an earlier visit.
+  SCCFunctions.clear();
+  for (CallGraphNode *Node : SCC)
+    if (Function *F = Node->getFunction()) {
+      SCCFunctions.insert(F);
+      Summaries.erase(F);
+    }
+  return false;
+}
+
+bool InlineCostAnalysis::doFinalization(CallGraph &CG) {
+  Summaries.clear();
+  SCCFunctions.clear();
   return false;
 }
 
@@ -1334,6 +1452,54 @@ InlineCost InlineCostAnalysis::getInlineCost(CallSite CS, int Threshold) {
   return getInlineCost(CS, CS.getCalledFunction(), Threshold);
 }
 
+/// \brief Test whether the cost of inlining through \p CS depends on the
+/// call site's arguments.
+///
+/// The cost analysis takes advantage of constant arguments, of pointer
+/// arguments derived from allocas in the caller, of pairs of pointer
+/// arguments sharing a base, and of non-null call site attributes. If none of
+/// these are present, every such call site sees the same callee body cost.
+static bool isArgumentIndependentCallSite(CallSite CS, Function &Callee) {
+  const DataLayout &DL = Callee.getParent()->getDataLayout();
+  SmallPtrSet<Value *, 8> PtrBases;
+  for (unsigned I = 0, E = CS.arg_size(); I != E; ++I) {
+    Value *Arg = CS.getArgument(I);
+    if (isa<Constant>(Arg))
+      return false;
+    if (CS.getAttributes().hasAttribute(I + 1, Attribute::NonNull) &&
+        !Callee.getAttributes().hasAttribute(I + 1, Attribute::NonNull))
+      return false;
+    if (!Arg->getType()->isPointerTy())
+      continue;
+
+    Value *Base = GetUnderlyingObject(Arg, DL, /*MaxLookup*/ 0);
+    if (isa<AllocaInst>(Base) || !PtrBases.insert(Base).second)
+      return false;
+  }
+  return true;
+}
+
+/// \brief Find or build the cost summary of \p Callee for use at \p CS.
+///
+/// Returns null if the call site's arguments matter to the cost, or if the
+/// callee is part of the SCC being visited and may still change.
+const InlineCostSummary *InlineCostAnalysis::getSummary(CallSite CS,
+                                                         Function &Callee) {
+  if (!UseCostSummaries || SCCFunctions.count(&Callee) ||
+      !isArgumentIndependentCallSite(CS, Callee))
+    return nullptr;
+
+  auto I = Summaries.find(&Callee);
+  if (I != Summaries.end())
+    return &I->second;
+
+  InlineCostSummary Summary;
+  CallAnalyzer CA(TTIWP->getTTI(Callee), ACT, Callee, SummaryCostCap,
+                  CallSite());
+  CA.computeSummary(Summary);
+  return &Summaries.insert(std::make_pair(&Callee, Summary)).first->second;
+}
+
 /// \brief Test that two functions either have or have not the given attribute
 ///        at the same time.
 template<typename AttrKind>
@@ -1387,7 +1553,7 @@ InlineCost InlineCostAnalysis::getInlineCost(CallSite CS, Function *Callee,
         << "...\n");
 
   CallAnalyzer CA(TTIWP->getTTI(*Callee), ACT, *Callee, Threshold, CS);
-  bool ShouldInline = CA.analyzeCall(CS);
+  bool ShouldInline = CA.analyzeCall(CS, getSummary(CS, *Callee));
 
   DEBUG(CA.dump());
 
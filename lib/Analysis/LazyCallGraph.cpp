@@ -680,6 +680,31 @@ LazyCallGraph::SCC *LazyCallGraph::getNextSCCInPostOrder() {
   }
 }
 
+void LazyCallGraph::buildSCCWavefronts(
+    SmallVectorImpl<SmallVector<SCC *, 4>> &Wavefronts) {
+  // The postorder walk visits every child SCC before its parents, so the
+  // wavefront of each child is already known when we reach an SCC.
+  DenseMap<SCC *, unsigned> WavefrontMap;
+  for (SCC &C : postorder_sccs()) {
+    unsigned Wavefront = 0;
+    for (Node *N : C)
+      for (Node &ChildN : *N) {
+        SCC *ChildC = lookupSCC(ChildN);
+        assert(ChildC && "Postorder walk left a child SCC unformed!");
+        if (ChildC == &C)
+          continue;
+        assert(WavefrontMap.count(ChildC) &&
+               "Child SCC visited after its parent!");
+        Wavefront = std::max(Wavefront, WavefrontMap.lookup(ChildC) + 1);
+      }
+
+    WavefrontMap.insert(std::make_pair(&C, Wavefront));
+    if (Wavefronts.size() <= Wavefront)
+      Wavefronts.resize(Wavefront + 1);
+    Wavefronts[Wavefront].push_back(&C);
+  }
+}
+
 char LazyCallGraphAnalysis::PassID;
 
 LazyCallGraphPrinterPass::LazyCallGraphPrinterPass(raw_ostream &OS) : OS(OS) {}
@@ -723,5 +748,15 @@ PreservedAnalyses LazyCallGraphPrinterPass::run(Module &M,
   for (LazyCallGraph::SCC &SCC : G.postorder_sccs())
     printSCC(OS, SCC);
 
+  SmallVector<SmallVector<LazyCallGraph::SCC *, 4>, 4> Wavefronts;
+  G.buildSCCWavefronts(Wavefronts);
+  for (unsigned i = 0, e = Wavefronts.size(); i != e; ++i) {
+    OS << "  Wavefront " << i << " with " << Wavefronts[i].size()
+       << " SCCs:\n";
+    for (LazyCallGraph::SCC *C : Wavefronts[i])
+      OS << "    " << C->getName() << "\n";
+    OS << "\n";
+  }
+
   return PreservedAnalyses::all();
 }
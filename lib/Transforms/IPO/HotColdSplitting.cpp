@@ -0,0 +1,334 @@
+//===- HotColdSplitting.cpp - Outline cold regions of functions -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass moves the cold parts of a function into separate functions so
+// that the hot code stays dense in the instruction cache.
+//
+// A block is a cold seed if it ends in unreachable, calls a function marked
+// cold, belongs to an exception handler, or has a zero count according to the
+// function entry count and the block frequencies. Coldness then spreads to
+// blocks whose successors are all cold and to blocks whose predecessors are
+// all cold. Each maximal single-entry group of cold blocks that is large
+// enough is outlined with the CodeExtractor into an internal function named
+// "<function>.cold.<n>", which is marked cold and noinline and, on ELF
+// targets, placed in a separate text section.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/IPO.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "hotcoldsplit"
+
+STATISTIC(NumColdRegionsOutlined, "Number of cold regions outlined");
+STATISTIC(NumColdRegionsRejected,
+          "Number of cold regions rejected by the cost heuristics");
+
+static cl::opt<unsigned>
+MinColdRegionSize("hotcoldsplit-threshold", cl::init(8), cl::Hidden,
+                  cl::desc("Minimum number of instructions in a cold region "
+                           "for it to be outlined"));
+
+static cl::opt<unsigned>
+MaxColdRegionInputs("hotcoldsplit-max-inputs", cl::init(6), cl::Hidden,
+                    cl::desc("Maximum number of values live into or out of "
+                             "a cold region for it to be outlined"));
+
+static cl::opt<bool>
+ForceSplit("hotcoldsplit-force", cl::init(false), cl::Hidden,
+           cl::desc("Outline every extractable cold region, ignoring the "
+                    "cost heuristics (for testing)"));
+
+static cl::opt<std::string>
+ColdSectionName("hotcoldsplit-cold-section", cl::init(".text.unlikely"),
+                cl::Hidden,
+                cl::desc("Section for outlined cold functions on ELF targets "
+                         "(empty to leave them in the default section)"));
+
+namespace {
+  class HotColdSplitting : public ModulePass {
+  public:
+    static char ID; // Pass identification, replacement for typeid
+    HotColdSplitting() : ModulePass(ID) {
+      initializeHotColdSplittingPass(*PassRegistry::getPassRegistry());
+    }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<BlockFrequencyInfo>();
+    }
+
+    bool runOnModule(Module &M) override;
+
+  private:
+    bool splitFunction(Function &F);
+    void findColdBlocks(Function &F, SmallPtrSetImpl<BasicBlock *> &Cold);
+    bool isWorthOutlining(ArrayRef<BasicBlock *> Region);
+    void outlineRegion(Function &F, ArrayRef<BasicBlock *> Region,
+                       DominatorTree &DT);
+
+    bool UseColdSection;
+    unsigned NumOutlinedInFunction;
+  };
+}
+
+char HotColdSplitting::ID = 0;
+INITIALIZE_PASS_BEGIN(HotColdSplitting, "hotcoldsplit",
+                      "Hot Cold Splitting", false, false)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfo)
+INITIALIZE_PASS_END(HotColdSplitting, "hotcoldsplit",
+                    "Hot Cold Splitting", false, false)
+
+ModulePass *llvm::createHotColdSplittingPass() {
+  return new HotColdSplitting();
+}
+
+/// Return true if \p BB contains something the CodeExtractor refuses to
+/// outline.
+static bool isUnextractable(const BasicBlock &BB) {
+  if (BB.isLandingPad())
+    return true;
+  for (const Instruction &I : BB) {
+    if (isa<AllocaInst>(I) || isa<InvokeInst>(I))
+      return true;
+    if (const CallInst *CI = dyn_cast<CallInst>(&I))
+      if (const Function *Callee = CI->getCalledFunction())
+        if (Callee->getIntrinsicID() == Intrinsic::vastart)
+          return true;
+  }
+  return false;
+}
+
+/// Return true if \p BB is cold on its own, without looking at its
+/// neighbours.
+static bool isColdSeed(const BasicBlock &BB) {
+  if (isa<UnreachableInst>(BB.getTerminator()) || BB.isLandingPad())
+    return true;
+  for (const Instruction &I : BB)
+    if (const CallInst *CI = dyn_cast<CallInst>(&I))
+      if (CI->hasFnAttr(Attribute::Cold))
+        return true;
+  return false;
+}
+
+/// Return true if a block with frequency \p Freq runs zero times when the
+/// function entry, with frequency \p EntryFreq, runs \p EntryCount times.
+static bool hasZeroCount(uint64_t Freq, uint64_t EntryFreq,
+                         uint64_t EntryCount) {
+  // Count = EntryCount * Freq / EntryFreq, computed without overflow.
+  APInt Count(128, EntryCount);
+  Count *= APInt(128, Freq);
+  return Count.ult(APInt(128, EntryFreq));
+}
+
+void HotColdSplitting::findColdBlocks(Function &F,
+                                      SmallPtrSetImpl<BasicBlock *> &Cold) {
+  BlockFrequencyInfo &BFI = getAnalysis<BlockFrequencyInfo>(F);
+  uint64_t EntryFreq = BFI.getEntryFreq();
+  Optional<uint64_t> EntryCount = F.getEntryCount();
+
+  for (BasicBlock &BB : F) {
+    if (isColdSeed(BB) ||
+        (EntryCount && hasZeroCount(BFI.getBlockFreq(&BB).getFrequency(),
+                                    EntryFreq, *EntryCount)))
+      Cold.insert(&BB);
+  }
+
+  // Exception handlers are cold: anything dominated by a landing pad is.
+  DominatorTree DT;
+  DT.recalculate(F);
+  for (BasicBlock &BB : F)
+    if (BB.isLandingPad())
+      if (DomTreeNode *Node = DT.getNode(&BB))
+        for (auto *N : depth_first(Node))
+          Cold.insert(N->getBlock());
+
+  // The entry block always stays with the function. A block that can only
+  // lead to cold code, or that can only be reached from cold code, is cold as
+  // well.
+  Cold.erase(&F.getEntryBlock());
+  bool Changed;
+  do {
+    Changed = false;
+    for (BasicBlock &BB : F) {
+      if (&BB == &F.getEntryBlock() || Cold.count(&BB))
+        continue;
+      bool AllSuccsCold = succ_begin(&BB) != succ_end(&BB);
+      for (BasicBlock *Succ : successors(&BB))
+        if (!Cold.count(Succ)) {
+          AllSuccsCold = false;
+          break;
+        }
+      bool AllPredsCold = pred_begin(&BB) != pred_end(&BB);
+      for (BasicBlock *Pred : predecessors(&BB))
+        if (!Cold.count(Pred)) {
+          AllPredsCold = false;
+          break;
+        }
+      if (AllSuccsCold || AllPredsCold) {
+        Cold.insert(&BB);
+        Changed = true;
+      }
+    }
+  } while (Changed);
+}
+
+bool HotColdSplitting::isWorthOutlining(ArrayRef<BasicBlock *> Region) {
+  if (ForceSplit)
+    return true;
+
+  unsigned Size = 0;
+  for (BasicBlock *BB : Region)
+    for (Instruction &I : *BB)
+      if (!isa<DbgInfoIntrinsic>(I))
+        ++Size;
+  if (Size < MinColdRegionSize)
+    return false;
+
+  // Every input and output turns into an argument of the outlined function,
+  // so a region that touches many values would make the hot path bigger.
+  SetVector<Value *> Inputs, Outputs;
+  CodeExtractor(Region).findInputsOutputs(Inputs, Outputs);
+  return Inputs.size() + Outputs.size() <= MaxColdRegionInputs;
+}
+
+void HotColdSplitting::outlineRegion(Function &F,
+                                     ArrayRef<BasicBlock *> Region,
+                                     DominatorTree &DT) {
+  DebugLoc DLoc = Region.front()->getTerminator()->getDebugLoc();
+  Function *Outlined = CodeExtractor(Region, &DT).extractCodeRegion();
+  if (!Outlined)
+    return;
+
+  Outlined->setName(F.getName() + ".cold." + Twine(++NumOutlinedInFunction));
+  Outlined->addFnAttr(Attribute::Cold);
+  Outlined->addFnAttr(Attribute::NoInline);
+  Outlined->addFnAttr(Attribute::MinSize);
+  if (UseColdSection)
+    Outlined->setSection(ColdSectionName);
+  ++NumColdRegionsOutlined;
+
+  emitOptimizationRemark(F.getContext(), DEBUG_TYPE, F, DLoc,
+                         Twine("outlined cold region into ") +
+                             Outlined->getName());
+}
+
+bool HotColdSplitting::splitFunction(Function &F) {
+  SmallPtrSet<BasicBlock *, 16> Cold;
+  findColdBlocks(F, Cold);
+  if (Cold.empty())
+    return false;
+
+  // Form regions in dominator tree preorder. A region starts at a cold block
+  // whose immediate dominator is hot (or is a landing pad, which can never be
+  // outlined itself) and takes the cold blocks it dominates, stopping at hot
+  // blocks and landing pads. The region must have a single entry, so if some
+  // block in it is reachable from outside the region, give up on it.
+  DominatorTree DT;
+  DT.recalculate(F);
+  std::vector<SmallVector<BasicBlock *, 8>> Regions;
+  SmallPtrSet<BasicBlock *, 16> InRegion;
+  for (auto *Node : depth_first(DT.getRootNode())) {
+    BasicBlock *Head = Node->getBlock();
+    if (!Node->getIDom() || InRegion.count(Head) || !Cold.count(Head) ||
+        Head->isLandingPad())
+      continue;
+    BasicBlock *IDom = Node->getIDom()->getBlock();
+    if (Cold.count(IDom) && !IDom->isLandingPad())
+      continue;
+
+    SmallVector<BasicBlock *, 8> Region;
+    SmallPtrSet<BasicBlock *, 16> RegionSet;
+    bool Extractable = true;
+    for (auto I = df_begin(Node), E = df_end(Node); I != E;) {
+      BasicBlock *BB = I->getBlock();
+      if (!Cold.count(BB) || BB->isLandingPad()) {
+        I.skipChildren();
+        continue;
+      }
+      if (isUnextractable(*BB)) {
+        Extractable = false;
+        break;
+      }
+      Region.push_back(BB);
+      RegionSet.insert(BB);
+      ++I;
+    }
+    if (!Extractable)
+      continue;
+
+    for (BasicBlock *BB : Region) {
+      if (BB == Head)
+        continue;
+      for (BasicBlock *Pred : predecessors(BB))
+        if (!RegionSet.count(Pred)) {
+          Extractable = false;
+          break;
+        }
+      if (!Extractable)
+        break;
+    }
+    if (!Extractable)
+      continue;
+
+    InRegion.insert(Region.begin(), Region.end());
+    if (!isWorthOutlining(Region)) {
+      ++NumColdRegionsRejected;
+      continue;
+    }
+    Regions.push_back(std::move(Region));
+  }
+
+  // The extractor rewrites the CFG around each region, so refresh the
+  // dominator tree before every extraction.
+  NumOutlinedInFunction = 0;
+  for (auto &Region : Regions) {
+    DT.recalculate(F);
+    outlineRegion(F, Region, DT);
+  }
+  return NumOutlinedInFunction != 0;
+}
+
+bool HotColdSplitting::runOnModule(Module &M) {
+  UseColdSection = !ColdSectionName.empty() &&
+                   Triple(M.getTargetTriple()).isOSBinFormatELF();
+
+  // Collect the functions up front, since outlining adds new ones.
+  std::vector<Function *> Worklist;
+  for (Function &F : M) {
+    if (F.isDeclaration() || F.hasFnAttribute(Attribute::OptimizeNone) ||
+        F.hasFnAttribute(Attribute::Cold))
+      continue;
+    Worklist.push_back(&F);
+  }
+
+  bool Changed = false;
+  for (Function *F : Worklist) {
+    DEBUG(dbgs() << "HotColdSplitting: visiting " << F->getName() << '\n');
+    Changed |= splitFunction(*F);
+  }
+  return Changed;
+}
@@ -61,16 +61,41 @@ static cl::opt<int>
 ColdThreshold("inlinecold-threshold", cl::Hidden, cl::init(225),
               cl::desc("Threshold for inlining functions with cold attribute"));
 
+// Thresholds used when the function entry counts of an instrumentation
+// profile are available. A callee is hot when its entry count is at least
+// HotCalleePercent of the hottest one in the module, and cold when it is at
+// most ColdCalleePerMille of it.
+static cl::opt<int>
+ProfileHotThreshold("inlinehot-threshold", cl::Hidden, cl::init(325),
+                    cl::desc("Threshold for inlining callees which are hot "
+                             "according to the profile"));
+
+static cl::opt<int>
+ProfileColdThreshold("inlinecold-profile-threshold", cl::Hidden, cl::init(0),
+                     cl::desc("Threshold for inlining callees which are cold "
+                              "according to the profile"));
+
+static cl::opt<unsigned>
+HotCalleePercent("inline-hot-callee-percent", cl::Hidden, cl::init(10),
+                 cl::desc("Percentage of the hottest function entry count "
+                          "above which a callee is hot"));
+
+static cl::opt<unsigned>
+ColdCalleePerMille("inline-cold-callee-permille", cl::Hidden, cl::init(1),
+                   cl::desc("Per mille of the hottest function entry count "
+                            "below which a callee is cold"));
+
 // Threshold to use when optsize is specified (and there is no -inline-limit).
 const int OptSizeThreshold = 75;
 
-Inliner::Inliner(char &ID) 
-  : CallGraphSCCPass(ID), InlineThreshold(InlineLimit), InsertLifetime(true) {}
+Inliner::Inliner(char &ID)
+  : CallGraphSCCPass(ID), InlineThreshold(InlineLimit), InsertLifetime(true),
+    MaxFunctionEntryCount(0) {}
 
 Inliner::Inliner(char &ID, int Threshold, bool InsertLifetime)
   : CallGraphSCCPass(ID), InlineThreshold(InlineLimit.getNumOccurrences() > 0 ?
                                           InlineLimit : Threshold),
-    InsertLifetime(InsertLifetime) {}
+    InsertLifetime(InsertLifetime), MaxFunctionEntryCount(0) {}
 
 /// For this class, we declare that we require and preserve the call graph.
 /// If the derived class implements this method, it should
@@ -290,9 +315,74 @@ unsigned Inliner::getInlineThreshold(CallSite CS) const {
       ColdThreshold < thres)
     thres = ColdThreshold;
 
+  // Listen to the profile. Hot callees are treated like hinted ones, and cold
+  // ones are only inlined when that makes the caller no bigger. As with the
+  // cold attribute, an explicit -inline-threshold overrides the default cold
+  // profile threshold.
+  switch (getProfileHotness(CS)) {
+  case PH_Hot:
+    if (ProfileHotThreshold > thres &&
+        !Caller->hasFnAttribute(Attribute::MinSize))
+      thres = ProfileHotThreshold;
+    break;
+  case PH_Cold:
+    if ((InlineLimit.getNumOccurrences() == 0 ||
+         ProfileColdThreshold.getNumOccurrences() > 0) &&
+        ProfileColdThreshold < thres)
+      thres = ProfileColdThreshold;
+    break;
+  case PH_Neutral:
+  case PH_Unknown:
+    break;
+  }
+
   return thres;
 }
 
+Inliner::ProfileHotness Inliner::getProfileHotness(CallSite CS) const {
+  Function *Callee = CS.getCalledFunction();
+  if (!MaxFunctionEntryCount || !Callee || Callee->isDeclaration())
+    return PH_Unknown;
+
+  Optional<uint64_t> EntryCount = Callee->getEntryCount();
+  if (!EntryCount)
+    return PH_Unknown;
+
+  // Scale the hottest entry count without floating point. Splitting off the
+  // remainder keeps the products from overflowing.
+  auto Scale = [&](unsigned Num, unsigned Denom) {
+    return MaxFunctionEntryCount / Denom * Num +
+           MaxFunctionEntryCount % Denom * Num / Denom;
+  };
+  uint64_t Count = EntryCount.getValue();
+  if (Count <= Scale(ColdCalleePerMille, 1000))
+    return PH_Cold;
+  if (Count >= Scale(HotCalleePercent, 100))
+    return PH_Hot;
+  return PH_Neutral;
+}
+
+/// Describe the profile data behind the inlining decision for CS, for use in
+/// the optimization remarks.
+static std::string describeProfile(CallSite CS,
+                                   Inliner::ProfileHotness Hotness) {
+  if (Hotness == Inliner::PH_Unknown)
+    return std::string();
+
+  std::string Str;
+  raw_string_ostream OS(Str);
+  OS << " [";
+  if (Hotness == Inliner::PH_Hot)
+    OS << "hot";
+  else if (Hotness == Inliner::PH_Cold)
+    OS << "cold";
+  else
+    OS << "warm";
+  OS << " callee, entry count=" << *CS.getCalledFunction()->getEntryCount()
+     << "]";
+  return OS.str();
+}
+
 static void emitAnalysis(CallSite CS, const Twine &Msg) {
   Function *Caller = CS.getCaller();
   LLVMContext &Ctx = Caller->getContext();
@@ -328,7 +418,8 @@ bool Inliner::shouldInline(CallSite CS) {
     emitAnalysis(CS, Twine(CS.getCalledFunction()->getName() +
                            " too costly to inline (cost=") +
                          Twine(IC.getCost()) + ", threshold=" +
-                         Twine(IC.getCostDelta() + IC.getCost()) + ")");
+                         Twine(IC.getCostDelta() + IC.getCost()) + ")" +
+                         describeProfile(CS, getProfileHotness(CS)));
     return false;
   }
   
@@ -410,7 +501,8 @@ bool Inliner::shouldInline(CallSite CS) {
   emitAnalysis(
       CS, CS.getCalledFunction()->getName() + Twine(" can be inlined into ") +
               CS.getCaller()->getName() + " with cost=" + Twine(IC.getCost()) +
-              " (threshold=" + Twine(IC.getCostDelta() + IC.getCost()) + ")");
+              " (threshold=" + Twine(IC.getCostDelta() + IC.getCost()) + ")" +
+              describeProfile(CS, getProfileHotness(CS)));
   return true;
 }
 
@@ -620,6 +712,15 @@ bool Inliner::runOnSCC(CallGraphSCC &SCC) {
   return Changed;
 }
 
+bool Inliner::doInitialization(CallGraph &CG) {
+  MaxFunctionEntryCount = 0;
+  for (Function &F : CG.getModule())
+    if (Optional<uint64_t> EntryCount = F.getEntryCount())
+      MaxFunctionEntryCount =
+          std::max(MaxFunctionEntryCount, EntryCount.getValue());
+  return false;
+}
+
 /// Remove now-dead linkonce functions at the end of
 /// processing to avoid breaking the SCC traversal.
 bool Inliner::doFinalization(CallGraph &CG) {
@@ -28,6 +28,12 @@
 // -- "FunctionPtr" instances are stored in std::set collection, so every
 //    std::set::insert operation will give you result in log(N) time.
 //
+// Full comparisons are expensive, so every function also gets a cheap
+// structural hash (see FunctionComparator::functionHash) that equal functions
+// always share. The set is ordered by hash first, so full comparisons only
+// happen between functions in the same hash bucket, and functions whose hash
+// is unique in the module are never inserted at all.
+//
 // When a match is found the functions are folded. If both functions are
 // overridable, we move the functionality into a new internal function and
 // leave two overridable thunks to it.
@@ -84,6 +90,7 @@
 #include "llvm/Transforms/IPO.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/Statistic.h"
@@ -111,6 +118,8 @@ STATISTIC(NumFunctionsMerged, "Number of functions merged");
 STATISTIC(NumThunksWritten, "Number of thunks generated");
 STATISTIC(NumAliasesWritten, "Number of aliases generated");
 STATISTIC(NumDoubleWeak, "Number of new functions created");
+STATISTIC(NumUniqueHashes,
+          "Number of functions skipped because their hash is unique");
 
 static cl::opt<unsigned> NumFunctionsForSanityCheck(
     "mergefunc-sanity",
@@ -133,6 +142,14 @@ public:
   /// Test whether the two functions have equivalent behaviour.
   int compare();
 
+  typedef uint64_t FunctionHash;
+
+  /// Hash the structure of a function: its signature shape, the CFG walked in
+  /// the same order as compare(), and the opcode, operand count and type of
+  /// each instruction. Functions that compare equal always hash equal, so the
+  /// hash can be used to bucket candidates before comparing them.
+  static FunctionHash functionHash(const Function &F);
+
 private:
   /// Test whether two basic blocks have equivalent behaviour.
   int compare(const BasicBlock *BBL, const BasicBlock *BBR);
@@ -390,10 +407,13 @@ private:
 
 class FunctionNode {
   mutable AssertingVH<Function> F;
+  FunctionComparator::FunctionHash Hash;
 
 public:
-  FunctionNode(Function *F) : F(F) {}
+  FunctionNode(Function *F)
+      : F(F), Hash(FunctionComparator::functionHash(*F)) {}
   Function *getFunc() const { return F; }
+  FunctionComparator::FunctionHash getHash() const { return Hash; }
 
   /// Replace the reference to the function F by the function G, assuming their
   /// implementations are equal.
@@ -405,7 +425,12 @@ public:
   }
 
   void release() { F = 0; }
+
+  /// Order by hash first so that full comparisons only happen between
+  /// functions with the same structure.
   bool operator<(const FunctionNode &RHS) const {
+    if (Hash != RHS.Hash)
+      return Hash < RHS.Hash;
     return (FunctionComparator(F, RHS.getFunc()).compare()) == -1;
   }
 };
@@ -1073,6 +1098,59 @@ int FunctionComparator::compare() {
   return 0;
 }
 
+/// Hash a type the way cmpTypes() sees it: pointers in address space 0 are
+/// the same as the pointer-sized integer, and only integer widths are
+/// distinguished beyond the type ID.
+static uint64_t hashType(Type *Ty, const DataLayout &DL) {
+  PointerType *PTy = dyn_cast<PointerType>(Ty);
+  if (PTy && PTy->getAddressSpace() == 0)
+    Ty = DL.getIntPtrType(Ty);
+  if (IntegerType *ITy = dyn_cast<IntegerType>(Ty))
+    return hashing::detail::hash_16_bytes(Type::IntegerTyID,
+                                          ITy->getBitWidth());
+  if (PTy)
+    return hashing::detail::hash_16_bytes(Type::PointerTyID,
+                                          PTy->getAddressSpace());
+  return Ty->getTypeID();
+}
+
+FunctionComparator::FunctionHash
+FunctionComparator::functionHash(const Function &F) {
+  using hashing::detail::hash_16_bytes;
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  // Start from an arbitrary non-zero state.
+  uint64_t H = 0x6acaa36bef8325c5ULL;
+  H = hash_16_bytes(H, F.isVarArg());
+  H = hash_16_bytes(H, F.arg_size());
+  H = hash_16_bytes(H, hashType(F.getReturnType(), DL));
+
+  // Walk the blocks in the same order as compare() so that the split of the
+  // opcode sequence into blocks contributes to the hash.
+  SmallVector<const BasicBlock *, 8> BBs;
+  SmallSet<const BasicBlock *, 16> VisitedBBs;
+  BBs.push_back(&F.getEntryBlock());
+  VisitedBBs.insert(BBs[0]);
+  while (!BBs.empty()) {
+    const BasicBlock *BB = BBs.pop_back_val();
+    // Block separator.
+    H = hash_16_bytes(H, 45798);
+    for (const Instruction &I : *BB) {
+      H = hash_16_bytes(H, I.getOpcode());
+      // GEPs are compared by offset rather than by operation, so their
+      // operand count and result type are not part of the structure.
+      if (isa<GetElementPtrInst>(I))
+        continue;
+      H = hash_16_bytes(H, I.getNumOperands());
+      H = hash_16_bytes(H, hashType(I.getType(), DL));
+    }
+    const TerminatorInst *Term = BB->getTerminator();
+    for (unsigned i = 0, e = Term->getNumSuccessors(); i != e; ++i)
+      if (VisitedBBs.insert(Term->getSuccessor(i)).second)
+        BBs.push_back(Term->getSuccessor(i));
+  }
+  return H;
+}
+
 namespace {
 
 /// MergeFunctions finds functions which will generate identical machine code,
@@ -1227,9 +1305,29 @@ bool MergeFunctions::doSanityCheck(std::vector<WeakVH> &Worklist) {
 bool MergeFunctions::runOnModule(Module &M) {
   bool Changed = false;
 
+  // Hash every candidate once. A function whose hash is unique in the module
+  // cannot be equal to any other function, and since merging only rewrites
+  // call operands it cannot gain a twin later either, so it is never queued.
+  std::vector<std::pair<FunctionComparator::FunctionHash, Function *>>
+      HashedFuncs;
   for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I) {
     if (!I->isDeclaration() && !I->hasAvailableExternallyLinkage())
-      Deferred.push_back(WeakVH(I));
+      HashedFuncs.push_back(
+          std::make_pair(FunctionComparator::functionHash(*I), &*I));
+  }
+  std::stable_sort(HashedFuncs.begin(), HashedFuncs.end(),
+                   [](const std::pair<FunctionComparator::FunctionHash,
+                                      Function *> &L,
+                      const std::pair<FunctionComparator::FunctionHash,
+                                      Function *> &R) {
+                     return L.first < R.first;
+                   });
+  for (auto I = HashedFuncs.begin(), E = HashedFuncs.end(); I != E; ++I) {
+    if ((I != HashedFuncs.begin() && std::prev(I)->first == I->first) ||
+        (std::next(I) != E && std::next(I)->first == I->first))
+      Deferred.push_back(WeakVH(I->second));
+    else
+      ++NumUniqueHashes;
   }
 
   do {
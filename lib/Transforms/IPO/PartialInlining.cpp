@@ -8,17 +8,28 @@
 //===----------------------------------------------------------------------===//
 //
 // This pass performs partial inlining, typically by inlining an if statement
-// that surrounds the body of the function.
+// that surrounds the body of the function.  Functions that do not have that
+// shape can still be partially inlined if the block frequencies show that most
+// of their code is cold: the cold regions are outlined into separate functions
+// and the remaining hot skeleton is inlined into the callers.
 //
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/IPO.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/BranchProbability.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/CodeExtractor.h"
 using namespace llvm;
@@ -26,10 +37,35 @@ using namespace llvm;
 #define DEBUG_TYPE "partialinlining"
 
 STATISTIC(NumPartialInlined, "Number of functions partially inlined");
+STATISTIC(NumColdRegionsOutlined,
+          "Number of cold regions outlined by the partial inliner");
+
+static cl::opt<bool>
+OutlineColdRegions("partial-inliner-cold-regions", cl::init(true), cl::Hidden,
+                   cl::desc("Outline cold regions found with block frequency "
+                            "info and inline the remaining hot skeleton"));
+
+static cl::opt<unsigned>
+ColdRegionPercent("partial-inliner-cold-percent", cl::init(10), cl::Hidden,
+                  cl::desc("Blocks whose frequency is at most this percentage "
+                           "of the entry frequency are considered cold"));
+
+static cl::opt<unsigned>
+MinColdRegionSize("partial-inliner-min-region-size", cl::init(4), cl::Hidden,
+                  cl::desc("Minimum number of instructions in a cold region "
+                           "worth outlining"));
+
+static cl::opt<unsigned>
+MaxSkeletonSize("partial-inliner-max-skeleton-size", cl::init(40), cl::Hidden,
+                cl::desc("Maximum number of instructions left in a function "
+                         "after outlining its cold regions for the remainder "
+                         "to be inlined into its callers"));
 
 namespace {
   struct PartialInliner : public ModulePass {
-    void getAnalysisUsage(AnalysisUsage &AU) const override { }
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<BlockFrequencyInfo>();
+    }
     static char ID; // Pass identification, replacement for typeid
     PartialInliner() : ModulePass(ID) {
       initializePartialInlinerPass(*PassRegistry::getPassRegistry());
@@ -39,12 +75,16 @@ namespace {
 
   private:
     Function* unswitchFunction(Function* F);
+    bool outlineColdRegions(Function *F);
   };
 }
 
 char PartialInliner::ID = 0;
-INITIALIZE_PASS(PartialInliner, "partial-inliner",
-                "Partial Inliner", false, false)
+INITIALIZE_PASS_BEGIN(PartialInliner, "partial-inliner",
+                      "Partial Inliner", false, false)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfo)
+INITIALIZE_PASS_END(PartialInliner, "partial-inliner",
+                    "Partial Inliner", false, false)
 
 ModulePass* llvm::createPartialInliningPass() { return new PartialInliner(); }
 
@@ -148,6 +188,160 @@ Function* PartialInliner::unswitchFunction(Function* F) {
   return extractedFunction;
 }
 
+/// Return the number of non-debug instructions in \p BB.
+static unsigned getBlockSize(const BasicBlock *BB) {
+  unsigned Size = 0;
+  for (const Instruction &I : *BB)
+    if (!isa<DbgInfoIntrinsic>(I))
+      ++Size;
+  return Size;
+}
+
+/// Return true if \p BB contains something the CodeExtractor refuses to
+/// outline.
+static bool isUnextractable(const BasicBlock *BB) {
+  if (BB->isLandingPad())
+    return true;
+  for (const Instruction &I : *BB) {
+    if (isa<AllocaInst>(I) || isa<InvokeInst>(I))
+      return true;
+    if (const CallInst *CI = dyn_cast<CallInst>(&I))
+      if (const Function *Callee = CI->getCalledFunction())
+        if (Callee->getIntrinsicID() == Intrinsic::vastart)
+          return true;
+  }
+  return false;
+}
+
+/// Find the cold regions of F using block frequency info, outline them from
+/// a copy of F, and inline the remaining hot skeleton into every direct
+/// caller.  Each region is the dominator subtree of a cold block whose
+/// immediate dominator is hot, minus the return blocks, so it has a single
+/// entry and never needs to return from F itself.
+bool PartialInliner::outlineColdRegions(Function *F) {
+  if (F->hasFnAttribute(Attribute::NoInline) || F->isVarArg())
+    return false;
+
+  unsigned FunctionSize = 0;
+  for (const BasicBlock &BB : *F)
+    FunctionSize += getBlockSize(&BB);
+  // Small functions are left to the regular inliner.
+  if (FunctionSize <= MaxSkeletonSize)
+    return false;
+
+  BlockFrequencyInfo &BFI = getAnalysis<BlockFrequencyInfo>(*F);
+  BlockFrequency ColdFreq = BlockFrequency(BFI.getEntryFreq()) *
+                            BranchProbability(ColdRegionPercent, 100);
+  auto IsCold = [&](BasicBlock *BB) {
+    return BFI.getBlockFreq(BB) <= ColdFreq;
+  };
+
+  DominatorTree DT;
+  DT.recalculate(*F);
+  std::vector<SmallVector<BasicBlock *, 8>> Regions;
+  SmallPtrSet<BasicBlock *, 16> InRegion;
+  unsigned OutlinedSize = 0;
+  // Walk the dominator tree in preorder so that outer regions are formed
+  // before any hot block nested inside them could start a region of its own.
+  for (auto *Node : depth_first(DT.getRootNode())) {
+    BasicBlock *BB = Node->getBlock();
+    if (!Node->getIDom() || InRegion.count(BB) || !IsCold(BB) ||
+        IsCold(Node->getIDom()->getBlock()))
+      continue;
+
+    SmallVector<BasicBlock *, 8> Region;
+    unsigned RegionSize = 0;
+    bool Extractable = true;
+    for (auto *N : depth_first(Node)) {
+      BasicBlock *RegionBB = N->getBlock();
+      if (isa<ReturnInst>(RegionBB->getTerminator()))
+        continue;
+      if (isUnextractable(RegionBB)) {
+        Extractable = false;
+        break;
+      }
+      Region.push_back(RegionBB);
+      RegionSize += getBlockSize(RegionBB);
+    }
+    if (!Extractable || Region.empty() || Region.front() != BB ||
+        RegionSize < MinColdRegionSize)
+      continue;
+
+    InRegion.insert(Region.begin(), Region.end());
+    Regions.push_back(std::move(Region));
+    OutlinedSize += RegionSize;
+  }
+
+  if (Regions.empty() || FunctionSize - OutlinedSize > MaxSkeletonSize)
+    return false;
+
+  ValueToValueMapTy VMap;
+  Function *DuplicateFunction = CloneFunction(F, VMap,
+                                              /*ModuleLevelChanges=*/false);
+  DuplicateFunction->setLinkage(GlobalValue::InternalLinkage);
+  F->getParent()->getFunctionList().push_back(DuplicateFunction);
+
+  // Outline every region of the copy, recomputing the dominator tree each
+  // time since the extractor rewrites the CFG around the region.  If any
+  // region cannot be extracted the skeleton is too big to inline, so give up
+  // and throw away the copy along with whatever was outlined from it.
+  DominatorTree DupDT;
+  SmallVector<Function *, 4> OutlinedFunctions;
+  for (auto &Region : Regions) {
+    SmallVector<BasicBlock *, 8> NewRegion;
+    for (BasicBlock *BB : Region)
+      NewRegion.push_back(cast<BasicBlock>(VMap[BB]));
+    DupDT.recalculate(*DuplicateFunction);
+    CodeExtractor CE(NewRegion, &DupDT);
+    Function *Outlined = CE.isEligible() ? CE.extractCodeRegion() : nullptr;
+    if (!Outlined) {
+      DuplicateFunction->eraseFromParent();
+      for (Function *OF : OutlinedFunctions)
+        OF->eraseFromParent();
+      return false;
+    }
+    Outlined->addFnAttr(Attribute::Cold);
+    Outlined->addFnAttr(Attribute::NoInline);
+    OutlinedFunctions.push_back(Outlined);
+  }
+
+  // Inline the hot skeleton into every direct caller.
+  InlineFunctionInfo IFI;
+  unsigned NumInlined = 0;
+  std::vector<User *> Users(F->user_begin(), F->user_end());
+  for (User *U : Users) {
+    CallSite CS(U);
+    if (!CS || CS.getCalledFunction() != F)
+      continue;
+    Instruction *Call = CS.getInstruction();
+    LLVMContext &Ctx = Call->getContext();
+    DebugLoc DLoc = Call->getDebugLoc();
+    Function *Caller = Call->getParent()->getParent();
+    CS.setCalledFunction(DuplicateFunction);
+    if (!InlineFunction(CS, IFI)) {
+      CS.setCalledFunction(F);
+      continue;
+    }
+    ++NumInlined;
+    emitOptimizationRemark(Ctx, DEBUG_TYPE, *Caller, DLoc,
+                           Twine("hot path of ") + F->getName() +
+                               " partially inlined into " +
+                               Caller->getName());
+  }
+
+  DuplicateFunction->replaceAllUsesWith(F);
+  DuplicateFunction->eraseFromParent();
+
+  if (!NumInlined) {
+    for (Function *OF : OutlinedFunctions)
+      OF->eraseFromParent();
+    return false;
+  }
+  NumColdRegionsOutlined += OutlinedFunctions.size();
+  ++NumPartialInlined;
+  return true;
+}
+
 bool PartialInliner::runOnModule(Module& M) {
   std::vector<Function*> worklist;
   worklist.reserve(M.size());
@@ -175,6 +369,8 @@ bool PartialInliner::runOnModule(Module& M) {
     if (Function* newFunc = unswitchFunction(currFunc)) {
       worklist.push_back(newFunc);
       changed = true;
+    } else if (OutlineColdRegions && outlineColdRegions(currFunc)) {
+      changed = true;
     }
     
   }
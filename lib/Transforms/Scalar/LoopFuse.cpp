@@ -0,0 +1,389 @@
+//===- LoopFuse.cpp - Loop Fusion Pass ------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the Loop Fusion Pass.  It fuses adjacent inner-most
+// loops that execute the same number of iterations, so that streaming passes
+// over the same arrays touch each element once while it is still in cache.
+//
+// Two loops are candidates if the exit block of the first is the preheader of
+// the second and contains nothing but a branch, which makes them control-flow
+// equivalent, and if ScalarEvolution proves their backedge-taken counts equal.
+// The body of the second loop is then placed after the body of the first and
+// both share the second loop's exit condition.
+//
+// Fusion moves the accesses of iteration i of the second loop ahead of the
+// accesses of iterations i+1... of the first one.  It is legal unless such a
+// pair conflicts.  Pairs that DependenceAnalysis proves independent or that
+// access distinct identified objects are fine; for affine accesses with the
+// same stride the dependence distance is checked directly.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#define LFUSE_NAME "loop-fusion"
+#define DEBUG_TYPE LFUSE_NAME
+
+using namespace llvm;
+
+static cl::opt<unsigned> FusionSizeThreshold(
+    "loop-fusion-size-threshold", cl::init(200), cl::Hidden,
+    cl::desc("Do not fuse loops whose combined body exceeds this number of "
+             "instructions"));
+
+static cl::opt<bool> FusionRequireReuse(
+    "loop-fusion-require-reuse", cl::init(true), cl::Hidden,
+    cl::desc("Only fuse loops that access at least one common object"));
+
+STATISTIC(NumLoopsFused, "Number of loops fused");
+
+namespace {
+/// \brief The memory accesses of a candidate loop.
+struct LoopAccesses {
+  SmallVector<Instruction *, 16> Accesses;
+  SmallPtrSet<Value *, 8> Objects;
+  unsigned Size;
+
+  LoopAccesses() : Size(0) {}
+};
+
+class LoopFuse : public FunctionPass {
+public:
+  LoopFuse() : FunctionPass(ID) {
+    initializeLoopFusePass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnFunction(Function &F) override {
+    if (skipOptnoneFunction(F))
+      return false;
+
+    LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+    SE = &getAnalysis<ScalarEvolution>();
+    DA = &getAnalysis<DependenceAnalysis>();
+    DL = &F.getParent()->getDataLayout();
+
+    // Collect the inner-most loops up front; fusion deletes loops and would
+    // invalidate iterators into the loop tree.
+    SmallVector<Loop *, 8> Worklist;
+    for (Loop *TopLevelLoop : *LI)
+      for (Loop *L : depth_first(TopLevelLoop))
+        if (L->empty())
+          Worklist.push_back(L);
+
+    bool Changed = false;
+    SmallPtrSet<Loop *, 8> Removed;
+    for (Loop *L : Worklist) {
+      if (Removed.count(L))
+        continue;
+      // Keep fusing the following loops into L as long as that works.
+      while (Loop *Next = getAdjacentLoop(L)) {
+        if (!tryToFuse(F, L, Next))
+          break;
+        Removed.insert(Next);
+        Changed = true;
+      }
+    }
+
+    if (Changed)
+      DT->recalculate(F);
+    return Changed;
+  }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequiredID(LoopSimplifyID);
+    AU.addRequiredID(LCSSAID);
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addPreserved<LoopInfoWrapperPass>();
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addPreserved<DominatorTreeWrapperPass>();
+    AU.addRequired<ScalarEvolution>();
+    AU.addRequired<DependenceAnalysis>();
+  }
+
+  static char ID;
+
+private:
+  /// \brief Returns the inner-most loop whose preheader is the exit block of
+  /// \p L, if that block does nothing but branch to it.
+  Loop *getAdjacentLoop(Loop *L) {
+    BasicBlock *Exit = L->getExitBlock();
+    if (!Exit || Exit->getSinglePredecessor() != L->getLoopLatch())
+      return nullptr;
+    if (&Exit->front() != Exit->getTerminator())
+      return nullptr;
+    BasicBlock *Succ = Exit->getSingleSuccessor();
+    if (!Succ)
+      return nullptr;
+    Loop *Next = LI->getLoopFor(Succ);
+    if (!Next || Next == L || Next->getHeader() != Succ || !Next->empty() ||
+        Next->getLoopPreheader() != Exit ||
+        Next->getParentLoop() != L->getParentLoop())
+      return nullptr;
+    return Next;
+  }
+
+  /// \brief Checks the shape of a candidate loop and collects its memory
+  /// accesses.  \returns a reason for rejecting it, or nullptr.
+  const char *analyzeLoop(Loop *L, LoopAccesses &LA) {
+    if (!L->isLoopSimplifyForm())
+      return "loop is not in simplified form";
+    BasicBlock *Latch = L->getLoopLatch();
+    if (L->getExitingBlock() != Latch)
+      return "loop has multiple exits or does not exit from the latch";
+    if (!isa<BranchInst>(Latch->getTerminator()))
+      return "loop latch does not end in a branch";
+
+    for (BasicBlock *BB : L->getBlocks())
+      for (Instruction &I : *BB) {
+        if (isa<DbgInfoIntrinsic>(&I))
+          continue;
+        ++LA.Size;
+        if (!I.mayReadOrWriteMemory())
+          continue;
+        Value *Ptr = nullptr;
+        if (LoadInst *LdI = dyn_cast<LoadInst>(&I)) {
+          if (!LdI->isSimple())
+            return "loop contains a volatile or atomic access";
+          Ptr = LdI->getPointerOperand();
+        } else if (StoreInst *StI = dyn_cast<StoreInst>(&I)) {
+          if (!StI->isSimple())
+            return "loop contains a volatile or atomic access";
+          Ptr = StI->getPointerOperand();
+        } else {
+          return "loop contains a call that may access memory";
+        }
+        LA.Accesses.push_back(&I);
+        LA.Objects.insert(GetUnderlyingObject(Ptr, *DL));
+      }
+    return nullptr;
+  }
+
+  /// \brief Returns true if, once the loops are fused, the access \p J of the
+  /// second loop \p L2 never touches memory that \p I accesses in a later
+  /// iteration of the first loop \p L1.  Only handles affine accesses with
+  /// equal constant strides and a constant distance.
+  bool isFusionSafeDistance(Instruction *I, Loop *L1, Instruction *J,
+                            Loop *L2) {
+    auto *AR1 = dyn_cast<SCEVAddRecExpr>(SE->getSCEV(getPointerOperand(I)));
+    auto *AR2 = dyn_cast<SCEVAddRecExpr>(SE->getSCEV(getPointerOperand(J)));
+    if (!AR1 || !AR2 || AR1->getLoop() != L1 || AR2->getLoop() != L2 ||
+        !AR1->isAffine() || !AR2->isAffine())
+      return false;
+
+    auto *Step1 = dyn_cast<SCEVConstant>(AR1->getStepRecurrence(*SE));
+    auto *Step2 = dyn_cast<SCEVConstant>(AR2->getStepRecurrence(*SE));
+    if (!Step1 || !Step2 || Step1->getValue() != Step2->getValue())
+      return false;
+    auto *Dist = dyn_cast<SCEVConstant>(
+        SE->getMinusSCEV(AR2->getStart(), AR1->getStart()));
+    if (!Dist)
+      return false;
+
+    int64_t Stride = Step1->getValue()->getSExtValue();
+    int64_t Distance = Dist->getValue()->getSExtValue();
+    int64_t Size1 = DL->getTypeStoreSize(getAccessType(I));
+    int64_t Size2 = DL->getTypeStoreSize(getAccessType(J));
+    // With a positive stride, J in iteration i overlaps I in iteration i + 1
+    // or later iff Distance + Size2 > Stride; mirrored for negative strides.
+    if (Stride > 0)
+      return Distance + Size2 <= Stride;
+    if (Stride < 0)
+      return Distance >= Stride + Size1;
+    return false;
+  }
+
+  /// \brief Returns true if fusing \p L1 and \p L2 keeps all dependences
+  /// between their memory accesses.  Sets \p Culprit to the offending access
+  /// of the second loop otherwise.
+  bool checkDependences(Loop *L1, const LoopAccesses &LA1, Loop *L2,
+                        const LoopAccesses &LA2, Instruction *&Culprit) {
+    for (Instruction *I : LA1.Accesses)
+      for (Instruction *J : LA2.Accesses) {
+        if (!I->mayWriteToMemory() && !J->mayWriteToMemory())
+          continue;
+        Value *Obj1 = GetUnderlyingObject(getPointerOperand(I), *DL);
+        Value *Obj2 = GetUnderlyingObject(getPointerOperand(J), *DL);
+        if (Obj1 != Obj2 && isIdentifiedObject(Obj1) &&
+            isIdentifiedObject(Obj2))
+          continue;
+        if (!DA->depends(I, J, true))
+          continue;
+        if (isFusionSafeDistance(I, L1, J, L2))
+          continue;
+        DEBUG(dbgs() << "LFuse: Fusion-preventing dependence from " << *I
+                     << " to " << *J << "\n");
+        Culprit = J;
+        return false;
+      }
+    return true;
+  }
+
+  /// \brief Try to fuse \p L2 into \p L1, which immediately precedes it.
+  bool tryToFuse(Function &F, Loop *L1, Loop *L2) {
+    DEBUG(dbgs() << "\nLFuse: In \"" << F.getName() << "\" checking " << *L1
+                 << " and " << *L2 << "\n");
+
+    LoopAccesses LA1, LA2;
+    const char *Reason = analyzeLoop(L1, LA1);
+    if (!Reason)
+      Reason = analyzeLoop(L2, LA2);
+    if (Reason)
+      return missed(F, L1, Reason);
+
+    const SCEV *BTC1 = SE->getBackedgeTakenCount(L1);
+    const SCEV *BTC2 = SE->getBackedgeTakenCount(L2);
+    if (isa<SCEVCouldNotCompute>(BTC1) || BTC1 != BTC2)
+      return missed(F, L1, "trip counts of the loops are not known to match");
+
+    // Cost model: fusion pays off through reuse of the data the loops have in
+    // common, and costs register pressure in the combined body.
+    if (LA1.Size + LA2.Size > FusionSizeThreshold)
+      return missed(F, L1, "fused loop would be too large");
+    unsigned SharedObjects = 0;
+    for (Value *Obj : LA2.Objects)
+      SharedObjects += LA1.Objects.count(Obj);
+    if (FusionRequireReuse && !SharedObjects)
+      return missed(F, L1, "loops do not access any common data");
+
+    Instruction *Culprit = nullptr;
+    if (!checkDependences(L1, LA1, L2, LA2, Culprit))
+      return missed(F, L1, "a dependence between the loops prevents fusion");
+
+    fuse(L1, L2);
+    ++NumLoopsFused;
+    emitOptimizationRemark(F.getContext(), LFUSE_NAME, F, L1->getStartLoc(),
+                           "fused with the following loop (" +
+                               Twine(SharedObjects) +
+                               " common objects accessed)");
+    return true;
+  }
+
+  bool missed(Function &F, Loop *L, const char *Reason) {
+    DEBUG(dbgs() << "LFuse: Not fusing: " << Reason << "\n");
+    emitOptimizationRemarkMissed(F.getContext(), LFUSE_NAME, F,
+                                 L->getStartLoc(),
+                                 Twine("not fused with the following loop: ") +
+                                     Reason);
+    return false;
+  }
+
+  /// \brief Rewrite the CFG so that the body of \p L2 follows the body of
+  /// \p L1 in each iteration, controlled by the exit test of \p L2.
+  void fuse(Loop *L1, Loop *L2) {
+    BasicBlock *Preheader1 = L1->getLoopPreheader();
+    BasicBlock *Header1 = L1->getHeader();
+    BasicBlock *Latch1 = L1->getLoopLatch();
+    BasicBlock *Between = L2->getLoopPreheader();
+    BasicBlock *Header2 = L2->getHeader();
+    BasicBlock *Latch2 = L2->getLoopLatch();
+
+    SE->forgetLoop(L1);
+    SE->forgetLoop(L2);
+
+    // The backedge now comes from the second latch.
+    for (Instruction &I : *Header1) {
+      PHINode *PN = dyn_cast<PHINode>(&I);
+      if (!PN)
+        break;
+      PN->setIncomingBlock(PN->getBasicBlockIndex(Latch1), Latch2);
+    }
+
+    // The header phis of the second loop move to the fused header.  Their
+    // start values are defined before the first loop, since the block between
+    // the loops is empty.
+    while (PHINode *PN = dyn_cast<PHINode>(&Header2->front())) {
+      PN->setIncomingBlock(PN->getBasicBlockIndex(Between), Preheader1);
+      PN->moveBefore(Header1->getFirstNonPHI());
+    }
+
+    // The first body falls through into the second one; its exit test is
+    // dead.
+    BranchInst *Br1 = cast<BranchInst>(Latch1->getTerminator());
+    Value *Cond1 = Br1->isConditional() ? Br1->getCondition() : nullptr;
+    BranchInst::Create(Header2, Br1);
+    Br1->eraseFromParent();
+    if (Cond1)
+      RecursivelyDeleteTriviallyDeadInstructions(Cond1);
+
+    BranchInst *Br2 = cast<BranchInst>(Latch2->getTerminator());
+    for (unsigned i = 0, e = Br2->getNumSuccessors(); i != e; ++i)
+      if (Br2->getSuccessor(i) == Header2)
+        Br2->setSuccessor(i, Header1);
+
+    // Update the loop tree: the blocks of L2 now belong to L1.
+    SmallVector<BasicBlock *, 8> Blocks2(L2->block_begin(), L2->block_end());
+    if (Loop *Parent = L2->getParentLoop())
+      Parent->removeChildLoop(std::find(Parent->begin(), Parent->end(), L2));
+    else
+      LI->removeLoop(std::find(LI->begin(), LI->end(), L2));
+    for (BasicBlock *BB : Blocks2) {
+      L1->addBlockEntry(BB);
+      LI->changeLoopFor(BB, L1);
+    }
+    delete L2;
+
+    LI->removeBlock(Between);
+    Between->eraseFromParent();
+  }
+
+  static Value *getPointerOperand(Instruction *I) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(I))
+      return LI->getPointerOperand();
+    return cast<StoreInst>(I)->getPointerOperand();
+  }
+
+  static Type *getAccessType(Instruction *I) {
+    if (StoreInst *SI = dyn_cast<StoreInst>(I))
+      return SI->getValueOperand()->getType();
+    return I->getType();
+  }
+
+  LoopInfo *LI;
+  DominatorTree *DT;
+  ScalarEvolution *SE;
+  DependenceAnalysis *DA;
+  const DataLayout *DL;
+};
+} // anonymous namespace
+
+char LoopFuse::ID;
+static const char lfuse_name[] = "Loop Fusion";
+
+INITIALIZE_PASS_BEGIN(LoopFuse, LFUSE_NAME, lfuse_name, false, false)
+INITIALIZE_PASS_DEPENDENCY(LoopSimplify)
+INITIALIZE_PASS_DEPENDENCY(LCSSA)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolution)
+INITIALIZE_PASS_DEPENDENCY(DependenceAnalysis)
+INITIALIZE_PASS_END(LoopFuse, LFUSE_NAME, lfuse_name, false, false)
+
+namespace llvm {
+FunctionPass *createLoopFusePass() { return new LoopFuse(); }
+}
@@ -30,15 +30,20 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/Local.h"
 #include <algorithm>
+#include <map>
 using namespace llvm;
 
 #define DEBUG_TYPE "sccp"
@@ -49,6 +54,26 @@ STATISTIC(NumDeadBlocks , "Number of basic blocks unreachable");
 STATISTIC(IPNumInstRemoved, "Number of instructions removed by IPSCCP");
 STATISTIC(IPNumArgsElimed ,"Number of arguments constant propagated by IPSCCP");
 STATISTIC(IPNumGlobalConst, "Number of globals found to be constant by IPSCCP");
+STATISTIC(IPNumSpecialized, "Number of function specializations created by "
+                            "IPSCCP");
+
+static cl::opt<bool>
+EnableSpecialization("ipsccp-specialize-functions", cl::Hidden,
+                     cl::init(false),
+                     cl::desc("Clone internal functions for their most "
+                              "common constant argument tuples before "
+                              "IPSCCP"));
+
+static cl::opt<unsigned>
+SpecializeBudget("ipsccp-specialize-budget", cl::Hidden, cl::init(2000),
+                 cl::desc("Maximum number of instructions IPSCCP may add to "
+                          "the module by specializing functions"));
+
+static cl::opt<unsigned>
+MaxSpecializationsPerFunction("ipsccp-max-specializations", cl::Hidden,
+                              cl::init(3),
+                              cl::desc("Maximum number of specializations "
+                                       "IPSCCP creates for one function"));
 
 namespace {
 /// LatticeVal class - This class represents the different lattice values that
@@ -1690,12 +1715,168 @@ static bool AddressIsTaken(const GlobalValue *GV) {
   return false;
 }
 
+/// Return true if specializing on a constant value of A is likely to fold
+/// control flow: A decides a branch, switch or select, directly or through a
+/// comparison, or is called indirectly.
+static bool IsDispatchArgument(Argument &A) {
+  for (User *U : A.users()) {
+    if (isa<SwitchInst>(U) || isa<BranchInst>(U))
+      return true;
+    if (SelectInst *SI = dyn_cast<SelectInst>(U))
+      if (SI->getCondition() == &A)
+        return true;
+    CallSite CS(U);
+    if (CS && CS.getCalledValue() == &A)
+      return true;
+    if (CmpInst *CI = dyn_cast<CmpInst>(U))
+      for (User *CU : CI->users())
+        if (isa<BranchInst>(CU) || isa<SelectInst>(CU))
+          return true;
+  }
+  return false;
+}
+
+/// Count the instructions a clone of F adds to the module.
+static unsigned GetFunctionSize(Function &F) {
+  unsigned Size = 0;
+  for (BasicBlock &BB : F)
+    for (Instruction &I : BB)
+      if (!isa<DbgInfoIntrinsic>(I))
+        ++Size;
+  return Size;
+}
+
+/// Clone internal functions for the constant argument tuples their call sites
+/// pass most often, and point those call sites at the clones.
+///
+/// IPSCCP only propagates an argument when every call site agrees on its
+/// value. When a function is called with a few different constants, as is
+/// common for configuration-driven dispatch, the argument is overdefined and
+/// nothing folds. Giving each popular tuple its own copy of the function lets
+/// the solver fold the dispatch in each copy. Only arguments which decide
+/// control flow are considered, and the number of instructions cloned across
+/// the module is capped by -ipsccp-specialize-budget.
+static bool SpecializeFunctions(Module &M) {
+  SmallVector<Function *, 16> Candidates;
+  for (Function &F : M)
+    if (!F.isDeclaration() && F.hasLocalLinkage() && !AddressIsTaken(&F) &&
+        !F.hasFnAttribute(Attribute::NoDuplicate))
+      Candidates.push_back(&F);
+
+  unsigned Budget = SpecializeBudget;
+  bool Changed = false;
+  for (Function *F : Candidates) {
+    unsigned Size = GetFunctionSize(*F);
+    if (Size > Budget)
+      continue;
+
+    SmallVector<unsigned, 4> DispatchArgs;
+    for (Argument &A : F->args())
+      if (IsDispatchArgument(A))
+        DispatchArgs.push_back(A.getArgNo());
+    if (DispatchArgs.empty())
+      continue;
+
+    // Group the call sites by the constants they pass for the dispatch
+    // arguments, keeping the groups in the order they are first seen so that
+    // the result doesn't depend on pointer values.
+    typedef std::vector<Constant *> ArgTuple;
+    std::map<ArgTuple, unsigned> GroupIndex;
+    SmallVector<std::pair<ArgTuple, SmallVector<CallSite, 4>>, 4> Groups;
+    unsigned NumCallSites = 0;
+    bool AllDirectCalls = true;
+    for (User *U : F->users()) {
+      CallSite CS(U);
+      if (!CS || CS.getCalledFunction() != F) {
+        AllDirectCalls = false;
+        break;
+      }
+      ++NumCallSites;
+
+      ArgTuple Tuple;
+      bool AnyConstant = false;
+      for (unsigned ArgNo : DispatchArgs) {
+        Constant *C = dyn_cast<Constant>(CS.getArgument(ArgNo));
+        if (C && isa<UndefValue>(C))
+          C = nullptr;
+        AnyConstant |= C != nullptr;
+        Tuple.push_back(C);
+      }
+      if (!AnyConstant)
+        continue;
+
+      auto Inserted = GroupIndex.insert(std::make_pair(Tuple, Groups.size()));
+      if (Inserted.second)
+        Groups.push_back(std::make_pair(Tuple, SmallVector<CallSite, 4>()));
+      Groups[Inserted.first->second].second.push_back(CS);
+    }
+    // If every call site already agrees, IPSCCP handles it without a clone.
+    if (!AllDirectCalls || Groups.empty() ||
+        (Groups.size() == 1 && Groups[0].second.size() == NumCallSites))
+      continue;
+
+    // Specialize the most frequent tuples first.
+    std::stable_sort(Groups.begin(), Groups.end(),
+                     [](const std::pair<ArgTuple, SmallVector<CallSite, 4>> &A,
+                        const std::pair<ArgTuple, SmallVector<CallSite, 4>> &B) {
+                       return A.second.size() > B.second.size();
+                     });
+
+    unsigned NumClones = 0;
+    for (auto &Group : Groups) {
+      if (NumClones == MaxSpecializationsPerFunction || Size > Budget)
+        break;
+      // Leave at least one tuple calling the original; cloning for the last
+      // group would only rename the function.
+      if (Group.second.size() == NumCallSites)
+        break;
+
+      ValueToValueMapTy VMap;
+      Function *Clone = CloneFunction(F, VMap, /*ModuleLevelChanges=*/false);
+      Clone->setName(F->getName() + ".spec");
+      Clone->setLinkage(GlobalValue::InternalLinkage);
+      M.getFunctionList().insert(F, Clone);
+      for (CallSite CS : Group.second)
+        CS.setCalledFunction(Clone);
+      NumCallSites -= Group.second.size();
+
+      Budget -= Size;
+      ++NumClones;
+      ++IPNumSpecialized;
+      Changed = true;
+
+      std::string Msg;
+      raw_string_ostream OS(Msg);
+      OS << "specialized " << F->getName() << " as " << Clone->getName()
+         << " for " << Group.second.size() << " call site(s) passing";
+      for (unsigned i = 0, e = DispatchArgs.size(); i != e; ++i) {
+        OS << (i ? ", " : " ") << "arg " << DispatchArgs[i] << "=";
+        if (Constant *C = Group.first[i])
+          C->printAsOperand(OS, /*PrintType=*/false);
+        else
+          OS << "<variable>";
+      }
+      emitOptimizationRemark(M.getContext(), DEBUG_TYPE, *F,
+                             Group.second[0].getInstruction()->getDebugLoc(),
+                             OS.str());
+      DEBUG(dbgs() << "IPSCCP: " << OS.str() << "\n");
+    }
+  }
+  return Changed;
+}
+
 bool IPSCCP::runOnModule(Module &M) {
   const DataLayout &DL = M.getDataLayout();
   const TargetLibraryInfo *TLI =
       &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
   SCCPSolver Solver(DL, TLI);
 
+  // Give the solver a chance to fold call sites which disagree on constant
+  // arguments by splitting them across specialized clones.
+  bool MadeChanges = false;
+  if (EnableSpecialization)
+    MadeChanges |= SpecializeFunctions(M);
+
   // AddressTakenFunctions - This set keeps track of the address-taken functions
   // that are in the input.  As IPSCCP runs through and simplifies code,
   // functions that were address taken can end up losing their
@@ -1755,8 +1936,6 @@ bool IPSCCP::runOnModule(Module &M) {
       ResolvedUndefs |= Solver.ResolvedUndefsIn(*F);
   }
 
-  bool MadeChanges = false;
-
   // Iterate over all of the instructions in the module, replacing them with
   // constants if we have found them to be of constant values.
   //
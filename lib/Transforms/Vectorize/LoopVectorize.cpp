@@ -98,6 +98,7 @@
 #include "llvm/Transforms/Utils/Local.h"
 #include "llvm/Analysis/VectorUtils.h"
 #include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/UnrollLoop.h"
 #include <algorithm>
 #include <map>
 #include <tuple>
@@ -110,6 +111,8 @@ using namespace llvm::PatternMatch;
 
 STATISTIC(LoopsVectorized, "Number of loops vectorized");
 STATISTIC(LoopsAnalyzed, "Number of loops analyzed for vectorization");
+STATISTIC(OuterLoopsFlattened, "Number of inner loops fully unrolled to "
+                               "vectorize their parent loop");
 
 static cl::opt<bool>
 EnableIfConversion("enable-if-conversion", cl::init(true), cl::Hidden,
@@ -209,6 +212,46 @@ static cl::opt<bool> EnableCondStoresVectorization(
     "enable-cond-stores-vec", cl::init(false), cl::Hidden,
     cl::desc("Enable if predication of stores during vectorization."));
 
+/// Outer-loop vectorization. An outer loop whose only subloop is innermost and
+/// has a small constant trip count (the same for every outer iteration) is
+/// made innermost by fully unrolling that subloop, so that the regular
+/// machinery vectorizes across iterations of the outer loop:
+///   for (i = 0; i < N; ++i)            for (i = 0; i < N; i += VF)
+///     for (k = 0; k < 3; ++k)     =>     Out[i:i+VF-1] = In[i-1:i+VF-2] * W[0]
+///       Out[i] += In[i+k-1] * W[k];                    + In[i:i+VF-1] * W[1] ...
+static cl::opt<bool> EnableOuterLoopVectorization(
+    "vectorize-outer-loops", cl::init(false), cl::Hidden,
+    cl::desc("Vectorize outer loops whose inner loop has a small uniform "
+             "trip count"));
+
+static cl::opt<unsigned> OuterLoopMaxInnerTripCount(
+    "vectorize-outer-max-inner-trip-count", cl::init(8), cl::Hidden,
+    cl::desc("Maximum constant trip count of an inner loop that is unrolled "
+             "to vectorize its parent"));
+
+static cl::opt<unsigned> OuterLoopUnrollThreshold(
+    "vectorize-outer-unroll-threshold", cl::init(150), cl::Hidden,
+    cl::desc("Maximum size of a fully unrolled inner loop when vectorizing "
+             "its parent"));
+
+static cl::opt<bool> EnablePredicatedDivision(
+    "enable-predicated-div-vectorization", cl::init(true), cl::Hidden,
+    cl::desc("Vectorize integer divisions in predicated blocks by replacing "
+             "the divisor of masked-off lanes with one."));
+
+/// Epilogue vectorization. After vectorizing a loop at VF, its scalar
+/// remainder can still run up to VF * IC - 1 iterations, which dominates short
+/// loops when VF is wide. Vectorize the remainder once more at a smaller VF.
+static cl::opt<bool> EnableEpilogueVectorization(
+    "enable-epilogue-vectorization", cl::init(false), cl::Hidden,
+    cl::desc("Vectorize the scalar remainder of vectorized loops at a smaller "
+             "vectorization factor."));
+
+static cl::opt<unsigned> EpilogueVectorizationFactor(
+    "epilogue-vectorization-factor", cl::init(0), cl::Hidden,
+    cl::desc("Vectorization factor of vectorized epilogues (0 picks a quarter "
+             "of the main loop's factor, but at least 2)."));
+
 static cl::opt<unsigned> MaxNestedScalarReductionIC(
     "max-nested-scalar-reduction-interleave", cl::init(2), cl::Hidden,
     cl::desc("The maximum interleave count to use when interleaving a scalar "
@@ -1258,6 +1301,15 @@ public:
     writeHintsToMetadata(Hints);
   }
 
+  /// Mark the loop L, the scalar remainder of a vectorized loop, to be
+  /// vectorized again at width \p VF without interleaving.
+  void setEpilogueWidth(unsigned VF) {
+    Width.Value = VF;
+    Interleave.Value = 1;
+    Hint Hints[] = {Width, Interleave};
+    writeHintsToMetadata(Hints);
+  }
+
   /// Dumps all the hint information.
   std::string emitRemark() const {
     VectorizationReport R;
@@ -1423,6 +1475,15 @@ static void addInnerLoop(Loop &L, SmallVectorImpl<Loop *> &V) {
     addInnerLoop(*InnerL, V);
 }
 
+/// Collect the loops whose only subloop is an innermost loop.
+static void addOuterLoop(Loop &L, SmallVectorImpl<Loop *> &V) {
+  if (L.getSubLoops().size() == 1 && L.getSubLoops().front()->empty())
+    return V.push_back(&L);
+
+  for (Loop *InnerL : L)
+    addOuterLoop(*InnerL, V);
+}
+
 /// The LoopVectorize Pass.
 struct LoopVectorize : public FunctionPass {
   /// Pass identification, replacement for typeid
@@ -1447,6 +1508,9 @@ struct LoopVectorize : public FunctionPass {
   bool DisableUnrolling;
   bool AlwaysVectorize;
 
+  /// Scalar remainder loops that have been queued for epilogue vectorization.
+  SmallPtrSet<Loop *, 4> EpilogueLoops;
+
   BlockFrequency ColdEntryFreq;
 
   bool runOnFunction(Function &F) override {
@@ -1476,6 +1540,15 @@ struct LoopVectorize : public FunctionPass {
     if (!TTI->getNumberOfRegisters(true) && TTI->getMaxInterleaveFactor(1) < 2)
       return false;
 
+    bool Changed = false;
+    if (EnableOuterLoopVectorization) {
+      SmallVector<Loop *, 8> OuterLoops;
+      for (Loop *L : *LI)
+        addOuterLoop(*L, OuterLoops);
+      for (Loop *L : OuterLoops)
+        Changed |= flattenOuterLoop(L);
+    }
+
     // Build up a worklist of inner-loops to vectorize. This is necessary as
     // the act of vectorizing or partially unrolling a loop creates new loops
     // and can invalidate iterators across the loops.
@@ -1486,10 +1559,11 @@ struct LoopVectorize : public FunctionPass {
 
     LoopsAnalyzed += Worklist.size();
 
-    // Now walk the identified inner loops.
-    bool Changed = false;
+    // Now walk the identified inner loops. Vectorizing a loop may queue its
+    // scalar remainder for epilogue vectorization.
+    EpilogueLoops.clear();
     while (!Worklist.empty())
-      Changed |= processLoop(Worklist.pop_back_val());
+      Changed |= processLoop(Worklist.pop_back_val(), Worklist);
 
     // Process each loop nest in the function.
     return Changed;
@@ -1529,8 +1603,106 @@ struct LoopVectorize : public FunctionPass {
     }
   }
 
-  bool processLoop(Loop *L) {
+  /// Prepare the outer loop \p L for vectorization by fully unrolling its
+  /// only subloop, which must have a small constant trip count. \p L then
+  /// becomes an innermost loop and goes through the normal legality checks
+  /// and cost model, which decide whether vectorizing across its iterations
+  /// is legal and profitable. Returns true if the subloop was unrolled.
+  bool flattenOuterLoop(Loop *L) {
+    Loop *Inner = L->getSubLoops().front();
+    Function *F = L->getHeader()->getParent();
+
+    LoopVectorizeHints Hints(L, DisableUnrolling);
+    if (Hints.getForce() == LoopVectorizeHints::FK_Disabled ||
+        (Hints.getWidth() == 1 && Hints.getInterleave() == 1))
+      return false;
+    if (!AlwaysVectorize && Hints.getForce() != LoopVectorizeHints::FK_Enabled)
+      return false;
+
+    // The outer loop must be countable and long enough to be worth
+    // vectorizing.
+    if (!L->isLoopSimplifyForm() || !L->getExitingBlock() ||
+        isa<SCEVCouldNotCompute>(SE->getBackedgeTakenCount(L)))
+      return false;
+    unsigned OuterTC = SE->getSmallConstantTripCount(L);
+    if (OuterTC > 0u && OuterTC < TinyTripCountVectorThreshold &&
+        Hints.getForce() != LoopVectorizeHints::FK_Enabled)
+      return false;
+
+    // The inner loop must run the same small number of iterations every time
+    // and have a single exit at its latch.
+    if (!Inner->isLoopSimplifyForm() ||
+        Inner->getExitingBlock() != Inner->getLoopLatch())
+      return false;
+    unsigned InnerTC = SE->getSmallConstantTripCount(Inner);
+    if (InnerTC < 2 || InnerTC > OuterLoopMaxInnerTripCount)
+      return false;
+
+    // Calls other than intrinsics and readnone library calls would stop the
+    // vectorizer anyway, so do not unroll for nothing.
+    for (BasicBlock *BB : L->getBlocks())
+      for (Instruction &I : *BB)
+        if (CallInst *CI = dyn_cast<CallInst>(&I))
+          if (!isa<IntrinsicInst>(CI) && !CI->doesNotAccessMemory())
+            return false;
+
+    SmallPtrSet<const Value *, 32> EphValues;
+    CodeMetrics::collectEphemeralValues(Inner, AC, EphValues);
+    CodeMetrics Metrics;
+    for (BasicBlock *BB : Inner->getBlocks())
+      Metrics.analyzeBasicBlock(BB, *TTI, EphValues);
+    if (Metrics.notDuplicatable ||
+        Metrics.NumInsts * InnerTC > OuterLoopUnrollThreshold)
+      return false;
+
+    DEBUG(dbgs() << "LV: Unrolling inner loop with trip count " << InnerTC
+                 << " to vectorize the outer loop in \"" << F->getName()
+                 << "\"\n");
+    SE->forgetLoop(L);
+    if (!UnrollLoop(Inner, InnerTC, InnerTC, /*AllowRuntime=*/false,
+                    /*AllowExpensiveTripCount=*/false, InnerTC, LI,
+                    /*PP=*/nullptr, /*LPM=*/nullptr, AC))
+      return false;
+
+    // UnrollLoop only maintains LoopInfo for the loop itself without a loop
+    // pass manager, so remove the now loop-less subloop and restore the
+    // canonical form of the outer loop.
+    LI->updateUnloop(Inner);
+    delete Inner;
+    DT->recalculate(*F);
+    simplifyLoop(L, DT, LI, this, AA, SE, AC);
+    formLCSSARecursively(*L, *DT, LI, SE);
+    ++OuterLoopsFlattened;
+
+    emitOptimizationRemarkAnalysis(
+        F->getContext(), DEBUG_TYPE, *F, L->getStartLoc(),
+        Twine("unrolled inner loop with uniform trip count ") +
+            Twine(InnerTC) + " to vectorize the outer loop");
+    return true;
+  }
+
+  /// Return the vectorization factor for the epilogue of a loop vectorized
+  /// with \p VF and interleave count \p IC, or 0 if the remainder is not
+  /// worth vectorizing again.
+  unsigned getEpilogueVF(Loop *L, unsigned VF, unsigned IC) {
+    if (!EnableEpilogueVectorization || EpilogueLoops.count(L))
+      return 0;
+    unsigned EpilogueVF = EpilogueVectorizationFactor;
+    if (!EpilogueVF)
+      EpilogueVF = std::max(VF / 4, 2U);
+    if (!isPowerOf2_32(EpilogueVF) || EpilogueVF >= VF)
+      return 0;
+    // With a known trip count the remainder is known too.
+    unsigned TC = SE->getSmallConstantTripCount(L);
+    if (TC > 0 && TC % (VF * IC) < EpilogueVF)
+      return 0;
+    return EpilogueVF;
+  }
+
+  bool processLoop(Loop *L, SmallVectorImpl<Loop *> &Worklist) {
     assert(L->empty() && "Only process inner loops.");
+    // An epilogue was already accepted when its main loop was vectorized.
+    bool IsEpilogue = EpilogueLoops.count(L);
 
 #ifndef NDEBUG
     const std::string DebugLocStr = getDebugLocString(L);
@@ -1569,7 +1741,8 @@ struct LoopVectorize : public FunctionPass {
       return false;
     }
 
-    if (!AlwaysVectorize && Hints.getForce() != LoopVectorizeHints::FK_Enabled) {
+    if (!AlwaysVectorize && !IsEpilogue &&
+        Hints.getForce() != LoopVectorizeHints::FK_Enabled) {
       DEBUG(dbgs() << "LV: Not vectorizing: No #pragma vectorize enable.\n");
       emitOptimizationRemarkAnalysis(F->getContext(), DEBUG_TYPE, *F,
                                      L->getStartLoc(), Hints.emitRemark());
@@ -1588,7 +1761,7 @@ struct LoopVectorize : public FunctionPass {
     // Check the loop for a trip count threshold:
     // do not vectorize loops with a tiny trip count.
     const unsigned TC = SE->getSmallConstantTripCount(L);
-    if (TC > 0u && TC < TinyTripCountVectorThreshold) {
+    if (TC > 0u && TC < TinyTripCountVectorThreshold && !IsEpilogue) {
       DEBUG(dbgs() << "LV: Found a loop with a very small trip count. "
                    << "This loop is not worth vectorizing.");
       if (Hints.getForce() == LoopVectorizeHints::FK_Enabled)
@@ -1675,6 +1848,7 @@ struct LoopVectorize : public FunctionPass {
       Unroller.vectorize(&LVL);
     } else {
       // If we decided that it is *legal* to vectorize the loop then do it.
+      unsigned EpilogueVF = getEpilogueVF(L, VF.Width, IC);
       InnerLoopVectorizer LB(L, SE, LI, DT, TLI, TTI, VF.Width, IC);
       LB.vectorize(&LVL);
       ++LoopsVectorized;
@@ -1687,9 +1861,24 @@ struct LoopVectorize : public FunctionPass {
 
       // Report the vectorization decision.
       emitOptimizationRemark(F->getContext(), DEBUG_TYPE, *F, L->getStartLoc(),
-                             Twine("vectorized loop (vectorization width: ") +
-                                 Twine(VF.Width) + ", interleaved count: " +
-                                 Twine(IC) + ")");
+                             Twine(IsEpilogue ? "vectorized epilogue loop"
+                                              : "vectorized loop") +
+                                 " (vectorization width: " + Twine(VF.Width) +
+                                 ", interleaved count: " + Twine(IC) + ")");
+
+      // L is now the scalar remainder. Queue it to be vectorized once more
+      // at the smaller epilogue width; the vectorizer gives it its own
+      // minimum-iteration and runtime checks and scalar remainder.
+      if (EpilogueVF) {
+        DEBUG(dbgs() << "LV: Vectorizing the epilogue with VF " << EpilogueVF
+                     << ".\n");
+        Hints.setEpilogueWidth(EpilogueVF);
+        LAA->forgetLoop(L);
+        EpilogueLoops.insert(L);
+        Worklist.push_back(L);
+        DEBUG(verifyFunction(*L->getHeader()->getParent()));
+        return true;
+      }
     }
 
     // Mark the loop as already vectorized to avoid vectorizing again.
@@ -3494,9 +3683,21 @@ void InnerLoopVectorizer::vectorizeBlockInLoop(BasicBlock *BB, PhiVector *PV) {
       VectorParts &A = getVectorValue(it->getOperand(0));
       VectorParts &B = getVectorValue(it->getOperand(1));
 
+      // A division in a predicated block divides by one in the lanes where
+      // the block does not execute, so that it cannot trap there.
+      VectorParts SafeB;
+      if (Legal->isMaskRequired(it)) {
+        VectorParts Mask = createBlockInMask(it->getParent());
+        Constant *One = ConstantInt::get(B[0]->getType(), 1);
+        for (unsigned Part = 0; Part < UF; ++Part)
+          SafeB.push_back(Builder.CreateSelect(Mask[Part], B[Part], One));
+      }
+      VectorParts &Divisor = SafeB.empty() ? B : SafeB;
+
       // Use this vector value for all users of the original instruction.
       for (unsigned Part = 0; Part < UF; ++Part) {
-        Value *V = Builder.CreateBinOp(BinOp->getOpcode(), A[Part], B[Part]);
+        Value *V = Builder.CreateBinOp(BinOp->getOpcode(), A[Part],
+                                       Divisor[Part]);
 
         if (BinaryOperator *VecOp = dyn_cast<BinaryOperator>(V))
           VecOp->copyIRFlags(BinOp);
@@ -4279,7 +4480,15 @@ bool LoopVectorizationLegality::blockCanBePredicated(BasicBlock *BB,
     case Instruction::SDiv:
     case Instruction::URem:
     case Instruction::SRem:
-      return false;
+      // A divisor known to be safe needs no predication. Otherwise the
+      // division can still be executed unconditionally if the masked-off
+      // lanes divide by one instead.
+      if (isSafeToSpeculativelyExecute(it))
+        continue;
+      if (!EnablePredicatedDivision)
+        return false;
+      MaskedOp.insert(it);
+      continue;
     }
   }
 
@@ -5060,8 +5269,14 @@ LoopVectorizationCostModel::getInstructionCost(Instruction *I, unsigned VF) {
       }
     }
 
-    return TTI.getArithmeticInstrCost(I->getOpcode(), VectorTy, Op1VK, Op2VK,
-                                      Op1VP, Op2VP);
+    unsigned Cost = TTI.getArithmeticInstrCost(I->getOpcode(), VectorTy,
+                                               Op1VK, Op2VK, Op1VP, Op2VP);
+    // A predicated division needs a select to make its divisor safe.
+    if (VF > 1 && Legal->isMaskRequired(I))
+      Cost += TTI.getCmpSelInstrCost(
+          Instruction::Select, VectorTy,
+          ToVectorTy(Type::getInt1Ty(I->getContext()), VF));
+    return Cost;
   }
   case Instruction::Select: {
     SelectInst *SI = cast<SelectInst>(I);
@@ -30,12 +30,14 @@
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/NoFolder.h"
+#include "llvm/IR/PatternMatch.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Verifier.h"
@@ -54,6 +56,8 @@ using namespace llvm;
 #define DEBUG_TYPE "SLP"
 
 STATISTIC(NumVectorInstructions, "Number of vector instructions generated");
+STATISTIC(NumBudgetExhausted,
+          "Number of functions that exhausted the SLP compile-time budget");
 
 static cl::opt<int>
     SLPCostThreshold("slp-threshold", cl::init(0), cl::Hidden,
@@ -73,6 +77,21 @@ static cl::opt<int>
 MaxVectorRegSizeOption("slp-max-reg-size", cl::init(128), cl::Hidden,
     cl::desc("Attempt to vectorize for this register size in bits"));
 
+static cl::opt<bool> CacheScheduleRegions(
+    "slp-cache-schedule-regions", cl::init(true), cl::Hidden,
+    cl::desc("Keep the scheduling region and its dependencies of a block "
+             "across tree building attempts until the block is modified"));
+
+static cl::opt<unsigned> FunctionBudget(
+    "slp-function-budget", cl::init(1000000), cl::Hidden,
+    cl::desc("Limit on the instructions visited while building SLP trees and "
+             "their scheduling regions in one function (0 = unlimited)"));
+
+static cl::opt<unsigned> MaxReductionBlocks(
+    "slp-max-rdx-blocks", cl::init(8), cl::Hidden,
+    cl::desc("Maximum number of straight-line blocks a horizontal reduction "
+             "tree may span"));
+
 namespace {
 
 // FIXME: Set this via cl::opt to allow overriding.
@@ -350,7 +369,8 @@ public:
   BoUpSLP(Function *Func, ScalarEvolution *Se, TargetTransformInfo *Tti,
           TargetLibraryInfo *TLi, AliasAnalysis *Aa, LoopInfo *Li,
           DominatorTree *Dt, AssumptionCache *AC)
-      : NumLoadsWantToKeepOrder(0), NumLoadsWantToChangeOrder(0), F(Func),
+      : BudgetUsed(0), NumLoadsWantToKeepOrder(0),
+        NumLoadsWantToChangeOrder(0), F(Func),
         SE(Se), TTI(Tti), TLI(TLi), AA(Aa), LI(Li), DT(Dt),
         Builder(Se->getContext()) {
     CodeMetrics::collectEphemeralValues(F, AC, EphValues);
@@ -381,12 +401,25 @@ public:
     ExternalUses.clear();
     NumLoadsWantToKeepOrder = 0;
     NumLoadsWantToChangeOrder = 0;
+    TreeBlockSchedules.clear();
     for (auto &Iter : BlocksSchedules) {
       BlockScheduling *BS = Iter.second.get();
-      BS->clear();
+      if (CacheScheduleRegions)
+        BS->clearBundles();
+      else
+        BS->clear();
     }
   }
 
+  /// \returns true if the per-function budget for building trees is used up.
+  /// Once it is, buildTree only produces gather nodes.
+  bool isBudgetExhausted() const {
+    return FunctionBudget && BudgetUsed >= FunctionBudget;
+  }
+
+  /// Charges \p Units instructions visited to the per-function budget.
+  void chargeBudget(unsigned Units) { BudgetUsed += Units; }
+
   /// \returns true if the memory operations A and B are consecutive.
   bool isConsecutiveAccess(Value *A, Value *B, const DataLayout &DL);
 
@@ -733,6 +766,25 @@ private:
       ++SchedulingRegionID;
     }
 
+    /// Dissolves all bundles and resets the dry-run schedule, but keeps the
+    /// scheduling region and the dependencies already calculated for it. This
+    /// is only valid as long as the block has not been modified.
+    void clearBundles() {
+      ReadyInsts.clear();
+      if (!ScheduleStart)
+        return;
+      for (Instruction *I = ScheduleStart; I != ScheduleEnd;
+           I = I->getNextNode()) {
+        ScheduleData *SD = getScheduleData(I);
+        SD->FirstInBundle = SD;
+        SD->NextInBundle = nullptr;
+        SD->IsScheduled = false;
+        SD->UnscheduledDeps = SD->Dependencies;
+        SD->UnscheduledDepsInBundle = SD->Dependencies;
+      }
+      initialFillReadyList(ReadyInsts);
+    }
+
     ScheduleData *getScheduleData(Value *V) {
       ScheduleData *SD = ScheduleDataMap[V];
       if (SD && SD->SchedulingRegionID == SchedulingRegionID)
@@ -797,14 +849,15 @@ private:
 
     /// Checks if a bundle of instructions can be scheduled, i.e. has no
     /// cyclic dependencies. This is only a dry-run, no instructions are
-    /// actually moved at this stage.
+    /// actually moved at this stage. If it fails, the bundle is not formed.
     bool tryScheduleBundle(ArrayRef<Value *> VL, BoUpSLP *SLP);
 
     /// Un-bundles a group of instructions.
     void cancelScheduling(ArrayRef<Value *> VL);
 
     /// Extends the scheduling region so that V is inside the region.
-    void extendSchedulingRegion(Value *V);
+    /// \returns false if the function's budget does not allow it.
+    bool extendSchedulingRegion(Value *V, BoUpSLP *SLP);
 
     /// Initialize the ScheduleData structures for new instructions in the
     /// scheduling region.
@@ -866,6 +919,10 @@ private:
   /// Attaches the BlockScheduling structures to basic blocks.
   MapVector<BasicBlock *, std::unique_ptr<BlockScheduling>> BlocksSchedules;
 
+  /// The blocks whose scheduling regions are used by the current tree. Other
+  /// blocks may still hold a region cached from an earlier tree.
+  SmallPtrSet<BlockScheduling *, 4> TreeBlockSchedules;
+
   /// Performs the "real" scheduling. Done before vectorization is actually
   /// performed in a basic block.
   void scheduleBlock(BlockScheduling *BS);
@@ -873,6 +930,10 @@ private:
   /// List of users to ignore during scheduling and that don't need extracting.
   ArrayRef<Value *> UserIgnoreList;
 
+  /// The number of instructions visited so far in this function while
+  /// building trees and scheduling regions, see isBudgetExhausted().
+  unsigned BudgetUsed;
+
   // Number of load-bundles, which contain consecutive loads.
   int NumLoadsWantToKeepOrder;
 
@@ -967,6 +1028,13 @@ void BoUpSLP::buildTree_rec(ArrayRef<Value *> VL, unsigned Depth) {
     return;
   }
 
+  chargeBudget(VL.size());
+  if (isBudgetExhausted()) {
+    DEBUG(dbgs() << "SLP: Gathering due to exhausted function budget.\n");
+    newTreeEntry(VL, false);
+    return;
+  }
+
   // Don't handle vectors.
   if (VL[0]->getType()->isVectorTy()) {
     DEBUG(dbgs() << "SLP: Gathering due to vector type.\n");
@@ -1074,10 +1142,10 @@ void BoUpSLP::buildTree_rec(ArrayRef<Value *> VL, unsigned Depth) {
     BSRef = llvm::make_unique<BlockScheduling>(BB);
   }
   BlockScheduling &BS = *BSRef.get();
+  TreeBlockSchedules.insert(&BS);
 
   if (!BS.tryScheduleBundle(VL, this)) {
     DEBUG(dbgs() << "SLP: We are not able to schedule this bundle!\n");
-    BS.cancelScheduling(VL);
     newTreeEntry(VL, false);
     return;
   }
@@ -2486,7 +2554,8 @@ Value *BoUpSLP::vectorizeTree() {
   
   // All blocks must be scheduled before any instructions are inserted.
   for (auto &BSIter : BlocksSchedules) {
-    scheduleBlock(BSIter.second.get());
+    if (TreeBlockSchedules.count(BSIter.second.get()))
+      scheduleBlock(BSIter.second.get());
   }
 
   Builder.SetInsertPoint(F->getEntryBlock().begin());
@@ -2577,6 +2646,11 @@ Value *BoUpSLP::vectorizeTree() {
     }
   }
 
+  // Instructions were moved, inserted and erased, so no cached scheduling
+  // region is valid anymore.
+  for (auto &BSIter : BlocksSchedules)
+    BSIter.second->clear();
+
   Builder.ClearInsertionPoint();
 
   return VectorizableTree[0].VectorizedValue;
@@ -2677,14 +2751,44 @@ bool BoUpSLP::BlockScheduling::tryScheduleBundle(ArrayRef<Value *> VL,
   if (isa<PHINode>(VL[0]))
     return true;
 
-  // Initialize the instruction bundle.
+  // Make sure that the scheduling region contains all instructions of the
+  // bundle.
   Instruction *OldScheduleEnd = ScheduleEnd;
+  bool ReSchedule = false;
+  bool RegionComplete = true;
+  for (Value *V : VL) {
+    if (!extendSchedulingRegion(V, SLP)) {
+      RegionComplete = false;
+      break;
+    }
+  }
+  if (ScheduleEnd != OldScheduleEnd) {
+    // The scheduling region got new instructions at the lower end (or it is a
+    // new region for the first bundle). This makes it necessary to
+    // recalculate all dependencies.
+    // It is seldom that this needs to be done a second time after adding the
+    // initial bundle to the region.
+    for (auto *I = ScheduleStart; I != ScheduleEnd; I = I->getNextNode()) {
+      ScheduleData *SD = getScheduleData(I);
+      SD->clearDependencies();
+    }
+    ReSchedule = true;
+  }
+  if (!RegionComplete) {
+    DEBUG(dbgs() << "SLP:  budget exhausted while extending the region of "
+                 << *VL[0] << "\n");
+    if (ReSchedule) {
+      resetSchedule();
+      initialFillReadyList(ReadyInsts);
+    }
+    return false;
+  }
+
+  // Initialize the instruction bundle.
   ScheduleData *PrevInBundle = nullptr;
   ScheduleData *Bundle = nullptr;
-  bool ReSchedule = false;
   DEBUG(dbgs() << "SLP:  bundle: " << *VL[0] << "\n");
   for (Value *V : VL) {
-    extendSchedulingRegion(V);
     ScheduleData *BundleMember = getScheduleData(V);
     assert(BundleMember &&
            "no ScheduleData for bundle member (maybe not in same basic block)");
@@ -2710,18 +2814,6 @@ bool BoUpSLP::BlockScheduling::tryScheduleBundle(ArrayRef<Value *> VL,
     BundleMember->FirstInBundle = Bundle;
     PrevInBundle = BundleMember;
   }
-  if (ScheduleEnd != OldScheduleEnd) {
-    // The scheduling region got new instructions at the lower end (or it is a
-    // new region for the first bundle). This makes it necessary to
-    // recalculate all dependencies.
-    // It is seldom that this needs to be done a second time after adding the
-    // initial bundle to the region.
-    for (auto *I = ScheduleStart; I != ScheduleEnd; I = I->getNextNode()) {
-      ScheduleData *SD = getScheduleData(I);
-      SD->clearDependencies();
-    }
-    ReSchedule = true;
-  }
   if (ReSchedule) {
     resetSchedule();
     initialFillReadyList(ReadyInsts);
@@ -2745,7 +2837,11 @@ bool BoUpSLP::BlockScheduling::tryScheduleBundle(ArrayRef<Value *> VL,
       schedule(pickedSD, ReadyInsts);
     }
   }
-  return Bundle->isReady();
+  if (!Bundle->isReady()) {
+    cancelScheduling(VL);
+    return false;
+  }
+  return true;
 }
 
 void BoUpSLP::BlockScheduling::cancelScheduling(ArrayRef<Value *> VL) {
@@ -2774,9 +2870,12 @@ void BoUpSLP::BlockScheduling::cancelScheduling(ArrayRef<Value *> VL) {
   }
 }
 
-void BoUpSLP::BlockScheduling::extendSchedulingRegion(Value *V) {
+bool BoUpSLP::BlockScheduling::extendSchedulingRegion(Value *V,
+                                                     BoUpSLP *SLP) {
   if (getScheduleData(V))
-    return;
+    return true;
+  if (SLP->isBudgetExhausted())
+    return false;
   Instruction *I = dyn_cast<Instruction>(V);
   assert(I && "bundle member must be an instruction");
   assert(!isa<PHINode>(I) && "phi nodes don't need to be scheduled");
@@ -2787,7 +2886,8 @@ void BoUpSLP::BlockScheduling::extendSchedulingRegion(Value *V) {
     ScheduleEnd = I->getNextNode();
     assert(ScheduleEnd && "tried to vectorize a TerminatorInst?");
     DEBUG(dbgs() << "SLP:  initialize schedule region to " << *I << "\n");
-    return;
+    SLP->chargeBudget(1);
+    return true;
   }
   // Search up and down at the same time, because we don't know if the new
   // instruction is above or below the existing scheduling region.
@@ -2795,13 +2895,14 @@ void BoUpSLP::BlockScheduling::extendSchedulingRegion(Value *V) {
   BasicBlock::reverse_iterator UpperEnd = BB->rend();
   BasicBlock::iterator DownIter(ScheduleEnd);
   BasicBlock::iterator LowerEnd = BB->end();
-  for (;;) {
+  for (unsigned Steps = 1;; ++Steps) {
     if (UpIter != UpperEnd) {
       if (&*UpIter == I) {
         initScheduleData(I, ScheduleStart, nullptr, FirstLoadStoreInRegion);
         ScheduleStart = I;
         DEBUG(dbgs() << "SLP:  extend schedule region start to " << *I << "\n");
-        return;
+        SLP->chargeBudget(2 * Steps);
+        return true;
       }
       UpIter++;
     }
@@ -2812,7 +2913,8 @@ void BoUpSLP::BlockScheduling::extendSchedulingRegion(Value *V) {
         ScheduleEnd = I->getNextNode();
         assert(ScheduleEnd && "tried to vectorize a TerminatorInst?");
         DEBUG(dbgs() << "SLP:  extend schedule region end to " << *I << "\n");
-        return;
+        SLP->chargeBudget(2 * Steps);
+        return true;
       }
       DownIter++;
     }
@@ -2879,6 +2981,7 @@ void BoUpSLP::BlockScheduling::calculateDependencies(ScheduleData *SD,
       if (!BundleMember->hasValidDependencies()) {
 
         DEBUG(dbgs() << "SLP:       update deps of " << *BundleMember << "\n");
+        SLP->chargeBudget(1);
         BundleMember->Dependencies = 0;
         BundleMember->resetUnscheduledDeps();
 
@@ -2963,6 +3066,7 @@ void BoUpSLP::BlockScheduling::calculateDependencies(ScheduleData *SD,
                 break;
             DistToSrc++;
           }
+          SLP->chargeBudget(DistToSrc);
         }
       }
       BundleMember = BundleMember->NextInBundle;
@@ -3128,6 +3232,19 @@ struct SLPVectorizer : public FunctionPass {
 
       // Vectorize trees that end at reductions.
       Changed |= vectorizeChainsInBlock(BB, R);
+
+      // Don't bother with the remaining blocks once the budget is used up.
+      if (R.isBudgetExhausted())
+        break;
+    }
+
+    if (R.isBudgetExhausted()) {
+      ++NumBudgetExhausted;
+      DEBUG(dbgs() << "SLP: Budget exhausted in \"" << F.getName() << "\".\n");
+      emitOptimizationRemarkAnalysis(
+          F.getContext(), SV_NAME, F, DebugLoc(),
+          "SLP vectorization stopped early, function exceeds the compile-time "
+          "budget (use -slp-function-budget to raise it)");
     }
 
     if (Changed) {
@@ -3516,10 +3633,27 @@ static Value *createRdxShuffleMask(unsigned VecLen, unsigned NumEltsToRdx,
 }
 
 
+/// \brief Returns true if \p From reaches \p To through a chain of blocks that
+/// each have a single successor, whose single predecessor is the block before
+/// it. Values computed in \p From then dominate and are always executed along
+/// with \p To, so a reduction may freely move them there.
+static bool isStraightLineBlockChain(BasicBlock *From, BasicBlock *To) {
+  for (unsigned Steps = 0; From != To; ++Steps) {
+    if (Steps == MaxReductionBlocks)
+      return false;
+    BasicBlock *Succ = From->getSingleSuccessor();
+    if (!Succ || Succ->getSinglePredecessor() != From)
+      return false;
+    From = Succ;
+  }
+  return true;
+}
+
 /// Model horizontal reductions.
 ///
-/// A horizontal reduction is a tree of reduction operations (currently add and
-/// fadd) that has operations that can be put into a vector as its leaf.
+/// A horizontal reduction is a tree of reduction operations (add, fadd, or
+/// an integer min/max select idiom) that has operations that can be put into
+/// a vector as its leaf.
 /// For example, this tree:
 ///
 /// mul mul mul mul
@@ -3543,13 +3677,27 @@ static Value *createRdxShuffleMask(unsigned VecLen, unsigned NumEltsToRdx,
 ///     |
 ///   *p =
 ///
+/// The tree may span a chain of straight-line blocks ending in the block of
+/// the root; the reduced values are vectorized per block.
+///
 class HorizontalReduction {
+  /// The kind of operation the reduction tree is built of.
+  enum ReductionKind {
+    RK_None,
+    RK_Arithmetic, ///< Binary operator given by ReductionOpcode.
+    RK_SMin,       ///< select(icmp slt a, b), a, b
+    RK_SMax,       ///< select(icmp sgt a, b), a, b
+    RK_UMin,       ///< select(icmp ult a, b), a, b
+    RK_UMax        ///< select(icmp ugt a, b), a, b
+  };
+
   SmallVector<Value *, 16> ReductionOps;
   SmallVector<Value *, 32> ReducedVals;
 
-  BinaryOperator *ReductionRoot;
+  Instruction *ReductionRoot;
   PHINode *ReductionPHI;
 
+  ReductionKind Kind;
   /// The opcode of the reduction.
   unsigned ReductionOpcode;
   /// The opcode of the values we perform a reduction on.
@@ -3562,8 +3710,9 @@ class HorizontalReduction {
 
 public:
   HorizontalReduction()
-    : ReductionRoot(nullptr), ReductionPHI(nullptr), ReductionOpcode(0),
-    ReducedValueOpcode(0), ReduxWidth(0), IsPairwiseReduction(false) {}
+    : ReductionRoot(nullptr), ReductionPHI(nullptr), Kind(RK_None),
+    ReductionOpcode(0), ReducedValueOpcode(0), ReduxWidth(0),
+    IsPairwiseReduction(false) {}
 
   /// \brief Try to find a reduction tree.
   bool matchAssociativeReduction(PHINode *Phi, BinaryOperator *B) {
@@ -3592,6 +3741,7 @@ public:
       return false;
 
     const DataLayout &DL = B->getModule()->getDataLayout();
+    Kind = RK_Arithmetic;
     ReductionOpcode = B->getOpcode();
     ReducedValueOpcode = 0;
     // FIXME: Register size should be a parameter to this function, so we can
@@ -3617,8 +3767,8 @@ public:
       unsigned EdgeToVist = Stack.back().second++;
       bool IsReducedValue = TreeN->getOpcode() != ReductionOpcode;
 
-      // Only handle trees in the current basic block.
-      if (TreeN->getParent() != B->getParent())
+      // Only handle trees in straight-line code ending in the root's block.
+      if (!isStraightLineBlockChain(TreeN->getParent(), B->getParent()))
         return false;
 
       // Each tree node needs to have one user except for the ultimate
@@ -3658,8 +3808,88 @@ public:
     return true;
   }
 
+  /// \brief Try to find a tree of integer min/max selects, e.g.
+  ///   %c = icmp sgt i32 %a, %b
+  ///   %m = select i1 %c, i32 %a, i32 %b
+  /// The compares are treated as part of the reduction operations.
+  bool matchMinMaxReduction(PHINode *Phi, SelectInst *S) {
+    ReductionKind RootKind = getMinMaxKind(S);
+    if (RootKind == RK_None)
+      return false;
+
+    // As for arithmetic reductions, a root that merges the phi with the rest
+    // of the tree is left alone and we start at the other operand.
+    if (Phi) {
+      if (S->getTrueValue() == Phi) {
+        S = dyn_cast<SelectInst>(S->getFalseValue());
+      } else if (S->getFalseValue() == Phi) {
+        S = dyn_cast<SelectInst>(S->getTrueValue());
+      }
+      Phi = nullptr;
+      if (!S || getMinMaxKind(S) != RootKind)
+        return false;
+    }
+
+    Type *Ty = S->getType();
+    if (!Ty->isIntegerTy() || !isValidElementType(Ty))
+      return false;
+
+    const DataLayout &DL = S->getModule()->getDataLayout();
+    Kind = RootKind;
+    ReductionOpcode = Instruction::Select;
+    ReducedValueOpcode = 0;
+    ReduxWidth = MinVecRegSize / DL.getTypeSizeInBits(Ty);
+    ReductionRoot = S;
+    ReductionPHI = nullptr;
+
+    if (ReduxWidth < 4)
+      return false;
+
+    // Post order traverse the tree of selects starting at S. An inner select
+    // is used exactly by its parent select and the compare feeding it.
+    SmallVector<std::pair<Instruction *, unsigned>, 32> Stack;
+    Stack.push_back(std::make_pair(S, 1));
+    while (!Stack.empty()) {
+      Instruction *TreeN = Stack.back().first;
+      unsigned EdgeToVist = Stack.back().second++;
+      bool IsReducedValue = TreeN != S && (!isa<SelectInst>(TreeN) ||
+                                           getMinMaxKind(TreeN) != Kind);
+
+      if (!isStraightLineBlockChain(TreeN->getParent(), S->getParent()))
+        return false;
+
+      if (TreeN != S && TreeN->getNumUses() != 2)
+        return false;
+
+      if (EdgeToVist == 3 || IsReducedValue) {
+        if (IsReducedValue) {
+          if (!ReducedValueOpcode)
+            ReducedValueOpcode = TreeN->getOpcode();
+          else if (ReducedValueOpcode != TreeN->getOpcode())
+            return false;
+          ReducedVals.push_back(TreeN);
+        } else {
+          Value *Cmp = cast<SelectInst>(TreeN)->getCondition();
+          if (!Cmp->hasOneUse())
+            return false;
+          ReductionOps.push_back(Cmp);
+          ReductionOps.push_back(TreeN);
+        }
+        Stack.pop_back();
+        continue;
+      }
+
+      // Visit the true or false value.
+      Instruction *Next = dyn_cast<Instruction>(TreeN->getOperand(EdgeToVist));
+      if (!Next)
+        return false;
+      Stack.push_back(std::make_pair(Next, 1));
+    }
+    return true;
+  }
+
   /// \brief Attempt to vectorize the tree found by
-  /// matchAssociativeReduction.
+  /// matchAssociativeReduction or matchMinMaxReduction.
   bool tryToReduce(BoUpSLP &V, TargetTransformInfo *TTI) {
     if (ReducedVals.empty())
       return false;
@@ -3668,45 +3898,63 @@ public:
     if (NumReducedVals < ReduxWidth)
       return false;
 
+    // A vectorizable bundle has to live in a single block, so reduce the
+    // values of each block of the tree separately.
+    MapVector<BasicBlock *, SmallVector<Value *, 16>> BlockVals;
+    for (Value *RV : ReducedVals)
+      BlockVals[cast<Instruction>(RV)->getParent()].push_back(RV);
+
     Value *VectorizedTree = nullptr;
     IRBuilder<> Builder(ReductionRoot);
     FastMathFlags Unsafe;
     Unsafe.setUnsafeAlgebra();
     Builder.SetFastMathFlags(Unsafe);
-    unsigned i = 0;
-
-    for (; i < NumReducedVals - ReduxWidth + 1; i += ReduxWidth) {
-      V.buildTree(makeArrayRef(&ReducedVals[i], ReduxWidth), ReductionOps);
-
-      // Estimate cost.
-      int Cost = V.getTreeCost() + getReductionCost(TTI, ReducedVals[i]);
-      if (Cost >= -SLPCostThreshold)
-        break;
-
-      DEBUG(dbgs() << "SLP: Vectorizing horizontal reduction at cost:" << Cost
-                   << ". (HorRdx)\n");
-
-      // Vectorize a tree.
-      DebugLoc Loc = cast<Instruction>(ReducedVals[i])->getDebugLoc();
-      Value *VectorizedRoot = V.vectorizeTree();
+    SmallVector<Value *, 16> ScalarVals;
+
+    for (auto &BV : BlockVals) {
+      SmallVectorImpl<Value *> &Vals = BV.second;
+      unsigned NumVals = Vals.size();
+      unsigned i = 0;
+      // Cover a non-power-of-two number of values with progressively
+      // narrower reductions, e.g. 7 values as 4 + 2 + 1 scalar.
+      for (unsigned Width = ReduxWidth; Width >= 2; Width /= 2) {
+        for (; i + Width <= NumVals; i += Width) {
+          ArrayRef<Value *> Bundle = makeArrayRef(&Vals[i], Width);
+          V.buildTree(Bundle, ReductionOps);
+
+          // Estimate cost.
+          int Cost = V.getTreeCost() + getReductionCost(TTI, Bundle[0], Width);
+          if (Cost >= -SLPCostThreshold) {
+            ScalarVals.append(Bundle.begin(), Bundle.end());
+            continue;
+          }
 
-      // Emit a reduction.
-      Value *ReducedSubTree = emitReduction(VectorizedRoot, Builder);
-      if (VectorizedTree) {
-        Builder.SetCurrentDebugLocation(Loc);
-        VectorizedTree = createBinOp(Builder, ReductionOpcode, VectorizedTree,
-                                     ReducedSubTree, "bin.rdx");
-      } else
-        VectorizedTree = ReducedSubTree;
+          DEBUG(dbgs() << "SLP: Vectorizing horizontal reduction at cost:"
+                       << Cost << ". (HorRdx)\n");
+
+          // Vectorize a tree.
+          DebugLoc Loc = cast<Instruction>(Bundle[0])->getDebugLoc();
+          Value *VectorizedRoot = V.vectorizeTree();
+
+          // Emit a reduction.
+          Value *ReducedSubTree =
+              emitReduction(VectorizedRoot, Builder, Width);
+          if (VectorizedTree) {
+            Builder.SetCurrentDebugLocation(Loc);
+            VectorizedTree =
+                createOp(Builder, VectorizedTree, ReducedSubTree, "bin.rdx");
+          } else
+            VectorizedTree = ReducedSubTree;
+        }
+      }
+      ScalarVals.append(Vals.begin() + i, Vals.end());
     }
 
     if (VectorizedTree) {
       // Finish the reduction.
-      for (; i < NumReducedVals; ++i) {
-        Builder.SetCurrentDebugLocation(
-          cast<Instruction>(ReducedVals[i])->getDebugLoc());
-        VectorizedTree = createBinOp(Builder, ReductionOpcode, VectorizedTree,
-                                     ReducedVals[i]);
+      for (Value *SV : ScalarVals) {
+        Builder.SetCurrentDebugLocation(cast<Instruction>(SV)->getDebugLoc());
+        VectorizedTree = createOp(Builder, VectorizedTree, SV);
       }
       // Update users.
       if (ReductionPHI) {
@@ -3721,19 +3969,56 @@ public:
 
 private:
 
-  /// \brief Calcuate the cost of a reduction.
-  int getReductionCost(TargetTransformInfo *TTI, Value *FirstReducedVal) {
-    Type *ScalarTy = FirstReducedVal->getType();
-    Type *VecTy = VectorType::get(ScalarTy, ReduxWidth);
-
-    int PairwiseRdxCost = TTI->getReductionCost(ReductionOpcode, VecTy, true);
-    int SplittingRdxCost = TTI->getReductionCost(ReductionOpcode, VecTy, false);
-
-    IsPairwiseReduction = PairwiseRdxCost < SplittingRdxCost;
-    int VecReduxCost = IsPairwiseReduction ? PairwiseRdxCost : SplittingRdxCost;
+  /// \brief Classify \p I as one of the min/max reduction kinds.
+  static ReductionKind getMinMaxKind(Instruction *I) {
+    using namespace PatternMatch;
+    Value *L, *R;
+    if (match(I, m_SMin(m_Value(L), m_Value(R))))
+      return RK_SMin;
+    if (match(I, m_SMax(m_Value(L), m_Value(R))))
+      return RK_SMax;
+    if (match(I, m_UMin(m_Value(L), m_Value(R))))
+      return RK_UMin;
+    if (match(I, m_UMax(m_Value(L), m_Value(R))))
+      return RK_UMax;
+    return RK_None;
+  }
 
-    int ScalarReduxCost =
-        ReduxWidth * TTI->getArithmeticInstrCost(ReductionOpcode, VecTy);
+  /// \brief Calcuate the cost of a reduction of \p Width values.
+  int getReductionCost(TargetTransformInfo *TTI, Value *FirstReducedVal,
+                       unsigned Width) {
+    Type *ScalarTy = FirstReducedVal->getType();
+    Type *VecTy = VectorType::get(ScalarTy, Width);
+
+    int VecReduxCost, ScalarReduxCost;
+    if (Kind == RK_Arithmetic) {
+      int PairwiseRdxCost = TTI->getReductionCost(ReductionOpcode, VecTy, true);
+      int SplittingRdxCost =
+          TTI->getReductionCost(ReductionOpcode, VecTy, false);
+
+      IsPairwiseReduction = PairwiseRdxCost < SplittingRdxCost;
+      VecReduxCost = IsPairwiseReduction ? PairwiseRdxCost : SplittingRdxCost;
+      ScalarReduxCost =
+          Width * TTI->getArithmeticInstrCost(ReductionOpcode, VecTy);
+    } else {
+      // There is no target hook for min/max reductions; model the splitting
+      // tree of shuffles, compares and selects emitReduction produces.
+      IsPairwiseReduction = false;
+      Type *CmpTy = CmpInst::makeCmpResultType(VecTy);
+      int LevelCost =
+          TTI->getShuffleCost(TargetTransformInfo::SK_ExtractSubvector, VecTy,
+                              0, VecTy) +
+          TTI->getCmpSelInstrCost(Instruction::ICmp, VecTy) +
+          TTI->getCmpSelInstrCost(Instruction::Select, VecTy, CmpTy);
+      VecReduxCost = Log2_32(Width) * LevelCost +
+                     TTI->getVectorInstrCost(Instruction::ExtractElement,
+                                             VecTy, 0);
+      Type *ScalarCmpTy = CmpInst::makeCmpResultType(ScalarTy);
+      ScalarReduxCost =
+          Width * (TTI->getCmpSelInstrCost(Instruction::ICmp, ScalarTy) +
+                   TTI->getCmpSelInstrCost(Instruction::Select, ScalarTy,
+                                           ScalarCmpTy));
+    }
 
     DEBUG(dbgs() << "SLP: Adding cost " << VecReduxCost - ScalarReduxCost
                  << " for reduction that starts with " << *FirstReducedVal
@@ -3751,33 +4036,59 @@ private:
     return Builder.CreateBinOp((Instruction::BinaryOps)Opcode, L, R, Name);
   }
 
+  /// \brief Emit one reduction operation of this reduction's kind.
+  Value *createOp(IRBuilder<> &Builder, Value *L, Value *R,
+                  const Twine &Name = "") {
+    CmpInst::Predicate Pred;
+    switch (Kind) {
+    case RK_Arithmetic:
+      return createBinOp(Builder, ReductionOpcode, L, R, Name);
+    case RK_SMin:
+      Pred = CmpInst::ICMP_SLT;
+      break;
+    case RK_SMax:
+      Pred = CmpInst::ICMP_SGT;
+      break;
+    case RK_UMin:
+      Pred = CmpInst::ICMP_ULT;
+      break;
+    case RK_UMax:
+      Pred = CmpInst::ICMP_UGT;
+      break;
+    default:
+      llvm_unreachable("Unknown reduction kind");
+    }
+    Value *Cmp = Builder.CreateICmp(Pred, L, R, "rdx.minmax.cmp");
+    return Builder.CreateSelect(Cmp, L, R, Name);
+  }
+
   /// \brief Emit a horizontal reduction of the vectorized value.
-  Value *emitReduction(Value *VectorizedValue, IRBuilder<> &Builder) {
+  Value *emitReduction(Value *VectorizedValue, IRBuilder<> &Builder,
+                       unsigned Width) {
     assert(VectorizedValue && "Need to have a vectorized tree node");
-    assert(isPowerOf2_32(ReduxWidth) &&
+    assert(isPowerOf2_32(Width) &&
            "We only handle power-of-two reductions for now");
 
     Value *TmpVec = VectorizedValue;
-    for (unsigned i = ReduxWidth / 2; i != 0; i >>= 1) {
+    for (unsigned i = Width / 2; i != 0; i >>= 1) {
       if (IsPairwiseReduction) {
         Value *LeftMask =
-          createRdxShuffleMask(ReduxWidth, i, true, true, Builder);
+          createRdxShuffleMask(Width, i, true, true, Builder);
         Value *RightMask =
-          createRdxShuffleMask(ReduxWidth, i, true, false, Builder);
+          createRdxShuffleMask(Width, i, true, false, Builder);
 
         Value *LeftShuf = Builder.CreateShuffleVector(
           TmpVec, UndefValue::get(TmpVec->getType()), LeftMask, "rdx.shuf.l");
         Value *RightShuf = Builder.CreateShuffleVector(
           TmpVec, UndefValue::get(TmpVec->getType()), (RightMask),
           "rdx.shuf.r");
-        TmpVec = createBinOp(Builder, ReductionOpcode, LeftShuf, RightShuf,
-                             "bin.rdx");
+        TmpVec = createOp(Builder, LeftShuf, RightShuf, "bin.rdx");
       } else {
         Value *UpperHalf =
-          createRdxShuffleMask(ReduxWidth, i, false, false, Builder);
+          createRdxShuffleMask(Width, i, false, false, Builder);
         Value *Shuf = Builder.CreateShuffleVector(
           TmpVec, UndefValue::get(TmpVec->getType()), UpperHalf, "rdx.shuf");
-        TmpVec = createBinOp(Builder, ReductionOpcode, TmpVec, Shuf, "bin.rdx");
+        TmpVec = createOp(Builder, TmpVec, Shuf, "bin.rdx");
       }
     }
 
@@ -3894,11 +4205,27 @@ bool SLPVectorizer::vectorizeChainsInBlock(BasicBlock *BB, BoUpSLP &R) {
       // Check that the PHI is a reduction PHI.
       if (P->getNumIncomingValues() != 2)
         return Changed;
+      // The reduction value comes either from BB itself or from the end of
+      // a chain of straight-line blocks starting at BB.
       Value *Rdx =
-          (P->getIncomingBlock(0) == BB
+          (isStraightLineBlockChain(BB, P->getIncomingBlock(0))
                ? (P->getIncomingValue(0))
-               : (P->getIncomingBlock(1) == BB ? P->getIncomingValue(1)
-                                               : nullptr));
+               : (isStraightLineBlockChain(BB, P->getIncomingBlock(1))
+                      ? P->getIncomingValue(1)
+                      : nullptr));
+
+      // Try to match and vectorize a min/max reduction.
+      if (SelectInst *SI = dyn_cast_or_null<SelectInst>(Rdx)) {
+        HorizontalReduction HorRdx;
+        if (ShouldVectorizeHor && HorRdx.matchMinMaxReduction(P, SI) &&
+            HorRdx.tryToReduce(R, TTI)) {
+          Changed = true;
+          it = BB->begin();
+          e = BB->end();
+        }
+        continue;
+      }
+
       // Check if this is a Binary Operator.
       BinaryOperator *BI = dyn_cast_or_null<BinaryOperator>(Rdx);
       if (!BI)
@@ -3932,7 +4259,7 @@ bool SLPVectorizer::vectorizeChainsInBlock(BasicBlock *BB, BoUpSLP &R) {
 
     // Try to vectorize horizontal reductions feeding into a store.
     if (ShouldStartVectorizeHorAtStore)
-      if (StoreInst *SI = dyn_cast<StoreInst>(it))
+      if (StoreInst *SI = dyn_cast<StoreInst>(it)) {
         if (BinaryOperator *BinOp =
                 dyn_cast<BinaryOperator>(SI->getValueOperand())) {
           HorizontalReduction HorRdx;
@@ -3944,7 +4271,33 @@ bool SLPVectorizer::vectorizeChainsInBlock(BasicBlock *BB, BoUpSLP &R) {
             e = BB->end();
             continue;
           }
+        } else if (SelectInst *Sel =
+                       dyn_cast<SelectInst>(SI->getValueOperand())) {
+          HorizontalReduction HorRdx;
+          if (HorRdx.matchMinMaxReduction(nullptr, Sel) &&
+              HorRdx.tryToReduce(R, TTI)) {
+            Changed = true;
+            it = BB->begin();
+            e = BB->end();
+            continue;
+          }
         }
+      }
+
+    // Try to vectorize min/max reductions feeding into a return.
+    if (ShouldVectorizeHor)
+      if (ReturnInst *RI = dyn_cast<ReturnInst>(it))
+        if (RI->getNumOperands() != 0)
+          if (SelectInst *Sel = dyn_cast<SelectInst>(RI->getOperand(0))) {
+            HorizontalReduction HorRdx;
+            if (HorRdx.matchMinMaxReduction(nullptr, Sel) &&
+                HorRdx.tryToReduce(R, TTI)) {
+              Changed = true;
+              it = BB->begin();
+              e = BB->end();
+              continue;
+            }
+          }
 
     // Try to vectorize horizontal reductions feeding into a return.
     if (ReturnInst *RI = dyn_cast<ReturnInst>(it))
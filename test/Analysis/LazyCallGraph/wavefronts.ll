@@ -0,0 +1,55 @@
+; RUN: opt -disable-output -passes=print-cg %s 2>&1 | FileCheck %s
+;
+; Check that the SCC DAG is partitioned into wavefronts of SCCs with no
+; caller/callee relationship, leaves first and each wavefront in postorder.
+
+define void @leaf1() {
+  ret void
+}
+
+define void @leaf2() {
+  ret void
+}
+
+define void @mid1() {
+  call void @leaf1()
+  ret void
+}
+
+define void @mid2() {
+  call void @leaf2()
+  call void @cycle()
+  ret void
+}
+
+define void @cycle() {
+  call void @leaf1()
+  call void @cycle2()
+  ret void
+}
+
+define void @cycle2() {
+  call void @cycle()
+  ret void
+}
+
+define void @root() {
+  call void @mid1()
+  call void @mid2()
+  call void @leaf2()
+  ret void
+}
+
+; CHECK-LABEL: Wavefront 0 with 2 SCCs:
+; CHECK-NEXT:    leaf1
+; CHECK-NEXT:    leaf2
+;
+; CHECK-LABEL: Wavefront 1 with 2 SCCs:
+; CHECK-NEXT:    mid1
+; CHECK-NEXT:    cycle
+;
+; CHECK-LABEL: Wavefront 2 with 1 SCCs:
+; CHECK-NEXT:    mid2
+;
+; CHECK-LABEL: Wavefront 3 with 1 SCCs:
+; CHECK-NEXT:    root
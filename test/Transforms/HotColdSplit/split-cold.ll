@@ -0,0 +1,61 @@
+; RUN: opt -hotcoldsplit -S < %s | FileCheck %s
+; RUN: opt -hotcoldsplit -hotcoldsplit-force -S < %s | FileCheck %s --check-prefix=FORCE
+; RUN: opt -hotcoldsplit -hotcoldsplit-cold-section= -S < %s | FileCheck %s --check-prefix=NOSECTION
+
+target triple = "x86_64-unknown-linux-gnu"
+
+declare void @report(i32, i32*)
+declare void @abort() noreturn nounwind
+declare void @log_slow(i32) cold
+
+; The path to unreachable is large enough to outline.
+; CHECK-LABEL: define i32 @check(
+; CHECK: call void @check.cold.1(
+; CHECK-NOT: @abort
+; CHECK: ret i32
+define i32 @check(i32* %p, i32 %x) {
+entry:
+  %ok = icmp sgt i32 %x, 0
+  br i1 %ok, label %fast, label %fail
+
+fast:
+  %v = load i32, i32* %p
+  %r = add i32 %v, %x
+  ret i32 %r
+
+fail:
+  call void @report(i32 %x, i32* %p)
+  %a = mul i32 %x, 3
+  call void @report(i32 %a, i32* %p)
+  %b = add i32 %a, %x
+  call void @report(i32 %b, i32* %p)
+  %c = xor i32 %b, %a
+  call void @report(i32 %c, i32* %p)
+  call void @abort()
+  unreachable
+}
+
+; A small region guarded by a call to a cold function is only outlined when
+; forced.
+; CHECK-LABEL: define void @small(
+; CHECK: call void @log_slow(
+; FORCE-LABEL: define void @small(
+; FORCE: call void @small.cold.1(
+define void @small(i32 %x) {
+entry:
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %slow, label %exit
+
+slow:
+  call void @log_slow(i32 %x)
+  br label %exit
+
+exit:
+  ret void
+}
+
+; CHECK: define internal void @check.cold.1({{.*}}) #[[ATTR:[0-9]+]] section ".text.unlikely"
+; CHECK: call void @abort()
+; CHECK: attributes #[[ATTR]] = { cold minsize noinline }
+
+; NOSECTION: define internal void @check.cold.1({{.*}}) #{{[0-9]+}} {
@@ -0,0 +1,126 @@
+; RUN: opt -S -inline < %s | FileCheck %s
+; RUN: opt -S -inline -inline-cost-summaries=false < %s | FileCheck %s
+; RUN: opt -S -inline -inline-cost-summary-cap=10 < %s | FileCheck %s
+;
+; Check that reusing a cached cost summary of the callee body makes the same
+; inlining decisions as analyzing the callee at every call site.
+
+; RUN: opt -S -inline -stats < %s 2>&1 | FileCheck %s -check-prefix=STATS
+; REQUIRES: asserts
+; STATS: Number of callee cost summaries computed
+; STATS: Number of call sites analyzed from a summary
+
+define i32 @small(i32 %a, i32 %b) {
+entry:
+  %add = add i32 %a, %b
+  %mul = mul i32 %add, %b
+  ret i32 %mul
+}
+
+define i32 @big(i32 %a, i32 %b) {
+entry:
+  %cmp = icmp eq i32 %b, 0
+  br i1 %cmp, label %then, label %else
+
+then:
+  %t0 = mul i32 %a, %a
+  %t1 = mul i32 %t0, %a
+  %t2 = mul i32 %t1, %a
+  %t3 = mul i32 %t2, %a
+  %t4 = mul i32 %t3, %a
+  %t5 = mul i32 %t4, %a
+  %t6 = mul i32 %t5, %a
+  %t7 = mul i32 %t6, %a
+  %t8 = mul i32 %t7, %a
+  %t9 = mul i32 %t8, %a
+  br label %exit
+
+else:
+  %e0 = sdiv i32 %a, %b
+  %e1 = sdiv i32 %e0, %b
+  %e2 = sdiv i32 %e1, %b
+  %e3 = sdiv i32 %e2, %b
+  %e4 = sdiv i32 %e3, %b
+  %e5 = sdiv i32 %e4, %b
+  %e6 = sdiv i32 %e5, %b
+  %e7 = sdiv i32 %e6, %b
+  %e8 = sdiv i32 %e7, %b
+  %e9 = sdiv i32 %e8, %b
+  %f0 = sdiv i32 %e9, %b
+  %f1 = sdiv i32 %f0, %b
+  %f2 = sdiv i32 %f1, %b
+  %f3 = sdiv i32 %f2, %b
+  %f4 = sdiv i32 %f3, %b
+  %f5 = sdiv i32 %f4, %b
+  %f6 = sdiv i32 %f5, %b
+  %f7 = sdiv i32 %f6, %b
+  %f8 = sdiv i32 %f7, %b
+  %f9 = sdiv i32 %f8, %b
+  %g0 = sdiv i32 %f9, %b
+  %g1 = sdiv i32 %g0, %b
+  %g2 = sdiv i32 %g1, %b
+  %g3 = sdiv i32 %g2, %b
+  %g4 = sdiv i32 %g3, %b
+  %g5 = sdiv i32 %g4, %b
+  %g6 = sdiv i32 %g5, %b
+  %g7 = sdiv i32 %g6, %b
+  %g8 = sdiv i32 %g7, %b
+  %g9 = sdiv i32 %g8, %b
+  %h0 = sdiv i32 %g9, %b
+  %h1 = sdiv i32 %h0, %b
+  %h2 = sdiv i32 %h1, %b
+  %h3 = sdiv i32 %h2, %b
+  %h4 = sdiv i32 %h3, %b
+  %h5 = sdiv i32 %h4, %b
+  %h6 = sdiv i32 %h5, %b
+  %h7 = sdiv i32 %h6, %b
+  %h8 = sdiv i32 %h7, %b
+  %h9 = sdiv i32 %h8, %b
+  %i0 = sdiv i32 %h9, %b
+  %i1 = sdiv i32 %i0, %b
+  %i2 = sdiv i32 %i1, %b
+  %i3 = sdiv i32 %i2, %b
+  %i4 = sdiv i32 %i3, %b
+  %i5 = sdiv i32 %i4, %b
+  %i6 = sdiv i32 %i5, %b
+  %i7 = sdiv i32 %i6, %b
+  %i8 = sdiv i32 %i7, %b
+  %i9 = sdiv i32 %i8, %b
+  br label %exit
+
+exit:
+  %r = phi i32 [ %t9, %then ], [ %i9, %else ]
+  ret i32 %r
+}
+
+define i32 @caller1(i32 %x, i32 %y) {
+; CHECK-LABEL: @caller1(
+; CHECK-NOT: call i32 @small
+; CHECK: call i32 @big(i32 %x, i32 %y)
+; CHECK: ret i32
+  %s = call i32 @small(i32 %x, i32 %y)
+  %b = call i32 @big(i32 %x, i32 %y)
+  %r = add i32 %s, %b
+  ret i32 %r
+}
+
+define i32 @caller2(i32 %x, i32 %y) {
+; CHECK-LABEL: @caller2(
+; CHECK-NOT: call i32 @small
+; CHECK: call i32 @big(i32 %y, i32 %x)
+; CHECK: ret i32
+  %s = call i32 @small(i32 %y, i32 %x)
+  %b = call i32 @big(i32 %y, i32 %x)
+  %r = add i32 %s, %b
+  ret i32 %r
+}
+
+; A constant argument folds the branch in @big, so this call site can't use
+; the summary and must be inlined.
+define i32 @caller3(i32 %x) {
+; CHECK-LABEL: @caller3(
+; CHECK-NOT: call
+; CHECK: ret i32
+  %b = call i32 @big(i32 %x, i32 0)
+  ret i32 %b
+}
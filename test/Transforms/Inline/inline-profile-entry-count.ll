@@ -0,0 +1,114 @@
+; RUN: opt < %s -inline -pass-remarks-analysis=inline -S 2>&1 | FileCheck %s
+; RUN: opt < %s -inline -inlinehot-threshold=225 -S | FileCheck %s -check-prefix=NOHOT
+; RUN: opt < %s -inline -inlinecold-profile-threshold=225 -S | FileCheck %s -check-prefix=NOCOLD
+;
+; Check that the function entry counts from an instrumentation profile raise
+; the threshold for hot callees, refuse cold ones, and show up in the remarks.
+
+; CHECK: hot can be inlined into caller with cost={{[0-9]+}} (threshold=325) [hot callee, entry count=100000]
+; CHECK: cold too costly to inline (cost={{[0-9]+}}, threshold=0) [cold callee, entry count=2]
+; CHECK: warm can be inlined into caller with cost={{[0-9]+}} (threshold=225) [warm callee, entry count=5000]
+
+define i32 @hot(i32 %a, i32 %b) !prof !1 {
+entry:
+  %c = icmp eq i32 %a, %b
+  br i1 %c, label %then, label %else
+
+then:
+  %t0 = mul i32 %a, %b
+  %t1 = mul i32 %t0, %b
+  %t2 = mul i32 %t1, %b
+  %t3 = mul i32 %t2, %b
+  %t4 = mul i32 %t3, %b
+  %t5 = mul i32 %t4, %b
+  %t6 = mul i32 %t5, %b
+  %t7 = mul i32 %t6, %b
+  %t8 = mul i32 %t7, %b
+  %t9 = mul i32 %t8, %b
+  %t10 = mul i32 %t9, %b
+  %t11 = mul i32 %t10, %b
+  %t12 = mul i32 %t11, %b
+  %t13 = mul i32 %t12, %b
+  %t14 = mul i32 %t13, %b
+  %t15 = mul i32 %t14, %b
+  %t16 = mul i32 %t15, %b
+  %t17 = mul i32 %t16, %b
+  %t18 = mul i32 %t17, %b
+  %t19 = mul i32 %t18, %b
+  %t20 = mul i32 %t19, %b
+  %t21 = mul i32 %t20, %b
+  %t22 = mul i32 %t21, %b
+  %t23 = mul i32 %t22, %b
+  br label %exit
+
+else:
+  %e0 = mul i32 %a, %b
+  %e1 = mul i32 %e0, %b
+  %e2 = mul i32 %e1, %b
+  %e3 = mul i32 %e2, %b
+  %e4 = mul i32 %e3, %b
+  %e5 = mul i32 %e4, %b
+  %e6 = mul i32 %e5, %b
+  %e7 = mul i32 %e6, %b
+  %e8 = mul i32 %e7, %b
+  %e9 = mul i32 %e8, %b
+  %e10 = mul i32 %e9, %b
+  %e11 = mul i32 %e10, %b
+  %e12 = mul i32 %e11, %b
+  %e13 = mul i32 %e12, %b
+  %e14 = mul i32 %e13, %b
+  %e15 = mul i32 %e14, %b
+  %e16 = mul i32 %e15, %b
+  %e17 = mul i32 %e16, %b
+  %e18 = mul i32 %e17, %b
+  %e19 = mul i32 %e18, %b
+  %e20 = mul i32 %e19, %b
+  %e21 = mul i32 %e20, %b
+  %e22 = mul i32 %e21, %b
+  %e23 = mul i32 %e22, %b
+  br label %exit
+
+exit:
+  %r = phi i32 [ %t23, %then ], [ %e23, %else ]
+  ret i32 %r
+}
+
+define i32 @cold(i32 %a, i32 %b) !prof !2 {
+entry:
+  %x = mul i32 %a, %b
+  %y = add i32 %x, %a
+  %z = xor i32 %y, %b
+  ret i32 %z
+}
+
+define i32 @warm(i32 %a, i32 %b) !prof !3 {
+entry:
+  %x = mul i32 %a, %b
+  %y = add i32 %x, %a
+  ret i32 %y
+}
+
+define i32 @caller(i32 %a, i32 %b) !prof !4 {
+; CHECK-LABEL: @caller(
+; CHECK-NOT: call i32 @hot
+; CHECK: call i32 @cold
+; CHECK-NOT: call i32 @warm
+; CHECK: ret i32
+
+; NOHOT-LABEL: @caller(
+; NOHOT: call i32 @hot
+
+; NOCOLD-LABEL: @caller(
+; NOCOLD-NOT: call i32 @cold
+  %1 = call i32 @hot(i32 %a, i32 %b)
+  %2 = call i32 @cold(i32 %a, i32 %b)
+  %3 = call i32 @warm(i32 %a, i32 %b)
+  %4 = add i32 %1, %2
+  %5 = add i32 %4, %3
+  ret i32 %5
+}
+
+!1 = !{!"function_entry_count", i64 100000}
+!2 = !{!"function_entry_count", i64 2}
+!3 = !{!"function_entry_count", i64 5000}
+!4 = !{!"function_entry_count", i64 200000}
@@ -0,0 +1,131 @@
+; RUN: opt -basicaa -loop-fusion -S < %s | FileCheck %s
+; RUN: opt -basicaa -loop-fusion -pass-remarks-missed=loop-fusion -S < %s 2>&1 | FileCheck %s --check-prefix=REMARK
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+
+; for (i = 0; i < 100; i++) a[i] = b[i] + 1;
+; for (i = 0; i < 100; i++) c[i] = a[i] * 2;
+;
+; The second loop reads what the first one wrote in the same iteration, so
+; the loops can be fused.
+
+; CHECK-LABEL: @fuse(
+; CHECK: loop1:
+; CHECK-NEXT: %i = phi i64 [ 0, %entry ], [ %i.next, %loop2 ]
+; CHECK-NEXT: %j = phi i64 [ 0, %entry ], [ %j.next, %loop2 ]
+; CHECK: store i32 %add
+; CHECK-NEXT: %i.next = add nuw nsw i64 %i, 1
+; CHECK-NEXT: br label %loop2
+; CHECK: loop2:
+; CHECK: store i32 %mul
+; CHECK: br i1 %cmp2, label %loop1, label %exit
+; CHECK-NOT: mid:
+define void @fuse(i32* noalias %a, i32* noalias %b, i32* noalias %c) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop1 ]
+  %pb = getelementptr inbounds i32, i32* %b, i64 %i
+  %vb = load i32, i32* %pb, align 4
+  %add = add nsw i32 %vb, 1
+  %pa = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 %add, i32* %pa, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %cmp1 = icmp ne i64 %i.next, 100
+  br i1 %cmp1, label %loop1, label %mid
+
+mid:
+  br label %loop2
+
+loop2:
+  %j = phi i64 [ 0, %mid ], [ %j.next, %loop2 ]
+  %pa2 = getelementptr inbounds i32, i32* %a, i64 %j
+  %va = load i32, i32* %pa2, align 4
+  %mul = mul nsw i32 %va, 2
+  %pc = getelementptr inbounds i32, i32* %c, i64 %j
+  store i32 %mul, i32* %pc, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %cmp2 = icmp ne i64 %j.next, 100
+  br i1 %cmp2, label %loop2, label %exit
+
+exit:
+  ret void
+}
+
+; for (i = 0; i < 100; i++) a[i] = b[i] + 1;
+; for (i = 0; i < 100; i++) c[i] = a[i + 1] * 2;
+;
+; Iteration i of the second loop reads a[i + 1], which the fused loop would
+; only write in iteration i + 1.
+
+; CHECK-LABEL: @no_fuse_forward_read(
+; CHECK: mid:
+; CHECK: loop2:
+; REMARK: remark: {{.*}}not fused with the following loop: a dependence between the loops prevents fusion
+define void @no_fuse_forward_read(i32* noalias %a, i32* noalias %b, i32* noalias %c) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop1 ]
+  %pb = getelementptr inbounds i32, i32* %b, i64 %i
+  %vb = load i32, i32* %pb, align 4
+  %add = add nsw i32 %vb, 1
+  %pa = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 %add, i32* %pa, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %cmp1 = icmp ne i64 %i.next, 100
+  br i1 %cmp1, label %loop1, label %mid
+
+mid:
+  br label %loop2
+
+loop2:
+  %j = phi i64 [ 0, %mid ], [ %j.next, %loop2 ]
+  %j.next = add nuw nsw i64 %j, 1
+  %pa2 = getelementptr inbounds i32, i32* %a, i64 %j.next
+  %va = load i32, i32* %pa2, align 4
+  %mul = mul nsw i32 %va, 2
+  %pc = getelementptr inbounds i32, i32* %c, i64 %j
+  store i32 %mul, i32* %pc, align 4
+  %cmp2 = icmp ne i64 %j.next, 100
+  br i1 %cmp2, label %loop2, label %exit
+
+exit:
+  ret void
+}
+
+; The trip counts differ.
+
+; CHECK-LABEL: @no_fuse_trip_count(
+; CHECK: mid:
+; REMARK: remark: {{.*}}not fused with the following loop: trip counts of the loops are not known to match
+define void @no_fuse_trip_count(i32* noalias %a, i32* noalias %b) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop1 ]
+  %pa = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 0, i32* %pa, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %cmp1 = icmp ne i64 %i.next, 100
+  br i1 %cmp1, label %loop1, label %mid
+
+mid:
+  br label %loop2
+
+loop2:
+  %j = phi i64 [ 0, %mid ], [ %j.next, %loop2 ]
+  %pa2 = getelementptr inbounds i32, i32* %a, i64 %j
+  %va = load i32, i32* %pa2, align 4
+  %pb = getelementptr inbounds i32, i32* %b, i64 %j
+  store i32 %va, i32* %pb, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %cmp2 = icmp ne i64 %j.next, 50
+  br i1 %cmp2, label %loop2, label %exit
+
+exit:
+  ret void
+}
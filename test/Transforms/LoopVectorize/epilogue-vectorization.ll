@@ -0,0 +1,45 @@
+; RUN: opt < %s -loop-vectorize -enable-epilogue-vectorization -force-vector-interleave=1 -force-vector-width=16 -pass-remarks=loop-vectorize -S 2>&1 | FileCheck %s
+; RUN: opt < %s -loop-vectorize -enable-epilogue-vectorization -epilogue-vectorization-factor=8 -force-vector-interleave=1 -force-vector-width=16 -S | FileCheck %s --check-prefix=VF8
+; RUN: opt < %s -loop-vectorize -force-vector-interleave=1 -force-vector-width=16 -S | FileCheck %s --check-prefix=NOEPI
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+
+; for (i = 0; i < n; ++i)
+;   a[i] = b[i] + 1;
+; The main loop runs at VF=16 and the remainder is vectorized again at VF=4,
+; leaving at most 3 iterations to the scalar loop.
+
+; CHECK: remark: {{.*}} vectorized loop (vectorization width: 16, interleaved count: 1)
+; CHECK: remark: {{.*}} vectorized epilogue loop (vectorization width: 4, interleaved count: 1)
+; CHECK-LABEL: @add_one(
+; CHECK: add nsw <16 x i32>
+; CHECK: add nsw <4 x i32>
+; CHECK: add nsw i32
+
+; VF8-LABEL: @add_one(
+; VF8: add nsw <16 x i32>
+; VF8: add nsw <8 x i32>
+
+; NOEPI-LABEL: @add_one(
+; NOEPI: add nsw <16 x i32>
+; NOEPI-NOT: add nsw <4 x i32>
+
+define void @add_one(i32* noalias %a, i32* noalias %b, i64 %n) {
+entry:
+  %cmp.entry = icmp sgt i64 %n, 0
+  br i1 %cmp.entry, label %loop, label %exit
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %b.addr = getelementptr inbounds i32, i32* %b, i64 %i
+  %x = load i32, i32* %b.addr, align 4
+  %y = add nsw i32 %x, 1
+  %a.addr = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 %y, i32* %a.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
@@ -0,0 +1,61 @@
+; RUN: opt < %s -loop-vectorize -vectorize-outer-loops -force-vector-interleave=1 -force-vector-width=4 -S | FileCheck %s
+; RUN: opt < %s -loop-vectorize -force-vector-interleave=1 -force-vector-width=4 -S | FileCheck %s --check-prefix=INNER
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+
+; A 3-tap stencil:
+;   for (i = 0; i < 1024; ++i) {
+;     float acc = 0;
+;     for (k = 0; k < 3; ++k)
+;       acc += in[i + k] * w[k];
+;     out[i] = acc;
+;   }
+; The inner loop has a uniform trip count of 3, so it is unrolled and the
+; outer loop is vectorized. Without -vectorize-outer-loops only the inner loop
+; is considered, and its trip count is too small to vectorize.
+
+; CHECK-LABEL: @stencil(
+; CHECK: vector.body:
+; CHECK: load <4 x float>
+; CHECK: load <4 x float>
+; CHECK: load <4 x float>
+; CHECK: fmul fast <4 x float>
+; CHECK: store <4 x float>
+
+; INNER-LABEL: @stencil(
+; INNER-NOT: <4 x float>
+; INNER: ret void
+
+define void @stencil(float* noalias %out, float* noalias %in, float* noalias %w) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %k = phi i64 [ 0, %outer ], [ %k.next, %inner ]
+  %acc = phi float [ 0.0, %outer ], [ %acc.next, %inner ]
+  %idx = add nuw nsw i64 %i, %k
+  %in.addr = getelementptr inbounds float, float* %in, i64 %idx
+  %x = load float, float* %in.addr, align 4
+  %w.addr = getelementptr inbounds float, float* %w, i64 %k
+  %c = load float, float* %w.addr, align 4
+  %m = fmul fast float %x, %c
+  %acc.next = fadd fast float %acc, %m
+  %k.next = add nuw nsw i64 %k, 1
+  %k.done = icmp eq i64 %k.next, 3
+  br i1 %k.done, label %outer.latch, label %inner
+
+outer.latch:
+  %sum = phi float [ %acc.next, %inner ]
+  %out.addr = getelementptr inbounds float, float* %out, i64 %i
+  store float %sum, float* %out.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %i.done = icmp eq i64 %i.next, 1024
+  br i1 %i.done, label %exit, label %outer
+
+exit:
+  ret void
+}
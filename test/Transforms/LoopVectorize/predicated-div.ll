@@ -0,0 +1,52 @@
+; RUN: opt < %s -loop-vectorize -force-vector-interleave=1 -force-vector-width=4 -S | FileCheck %s
+; RUN: opt < %s -loop-vectorize -force-vector-interleave=1 -force-vector-width=4 -enable-predicated-div-vectorization=false -S | FileCheck %s --check-prefix=DISABLED
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+
+; for (i = 0; i < n; ++i) {
+;   int x = a[i];
+;   if (b[i] != 0)
+;     x = x / b[i];
+;   a[i] = x;
+; }
+; The division only runs when b[i] is non-zero, so the masked-off lanes must
+; divide by one after if-conversion.
+
+; CHECK-LABEL: @cond_div(
+; CHECK: vector.body:
+; CHECK: %[[DIVISOR:.*]] = select <4 x i1> %{{.*}}, <4 x i32> %{{.*}}, <4 x i32> <i32 1, i32 1, i32 1, i32 1>
+; CHECK: sdiv <4 x i32> %{{.*}}, %[[DIVISOR]]
+; CHECK: store <4 x i32>
+
+; DISABLED-LABEL: @cond_div(
+; DISABLED-NOT: <4 x i32>
+; DISABLED: ret void
+
+define void @cond_div(i32* noalias %a, i32* noalias %b, i64 %n) {
+entry:
+  %cmp.entry = icmp sgt i64 %n, 0
+  br i1 %cmp.entry, label %loop, label %exit
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %latch ]
+  %a.addr = getelementptr inbounds i32, i32* %a, i64 %i
+  %x = load i32, i32* %a.addr, align 4
+  %b.addr = getelementptr inbounds i32, i32* %b, i64 %i
+  %y = load i32, i32* %b.addr, align 4
+  %nz = icmp ne i32 %y, 0
+  br i1 %nz, label %div, label %latch
+
+div:
+  %q = sdiv i32 %x, %y
+  br label %latch
+
+latch:
+  %r = phi i32 [ %q, %div ], [ %x, %loop ]
+  store i32 %r, i32* %a.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
@@ -0,0 +1,39 @@
+; RUN: opt -mergefunc -stats -S < %s 2>&1 | FileCheck %s
+; REQUIRES: asserts
+
+; @a and @b have the same structure and are merged. @c and @d have no
+; structural twin, so their hashes are unique and they are never compared.
+
+; CHECK-LABEL: define i32 @a(
+; CHECK: mul i32
+; CHECK-LABEL: define i32 @b(
+; CHECK-NEXT: tail call i32 @a(
+; CHECK-LABEL: define i32 @c(
+; CHECK: sdiv i32
+; CHECK-LABEL: define i64 @d(
+; CHECK: 1 mergefunc - Number of functions merged
+; CHECK: 2 mergefunc - Number of functions skipped because their hash is unique
+
+define i32 @a(i32 %x, i32 %y) {
+  %m = mul i32 %x, %y
+  %r = add i32 %m, 7
+  ret i32 %r
+}
+
+define i32 @b(i32 %x, i32 %y) {
+  %m = mul i32 %x, %y
+  %r = add i32 %m, 7
+  ret i32 %r
+}
+
+define i32 @c(i32 %x, i32 %y) {
+  %m = sdiv i32 %x, %y
+  %r = add i32 %m, 7
+  ret i32 %r
+}
+
+define i64 @d(i64 %x, i64 %y) {
+  %m = mul i64 %x, %y
+  %r = add i64 %m, 7
+  ret i64 %r
+}
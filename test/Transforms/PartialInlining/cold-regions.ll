@@ -0,0 +1,45 @@
+; RUN: opt < %s -partial-inliner -partial-inliner-max-skeleton-size=8 -S | FileCheck %s
+
+; The error handling in @callee is cold according to the branch weights, so it
+; is outlined and the remaining fast path is inlined into the caller.
+
+declare void @report(i32)
+declare void @log(i32*)
+
+define i32 @callee(i32* %p, i32 %x) {
+entry:
+  %ok = icmp sgt i32 %x, 0
+  br i1 %ok, label %fast, label %error, !prof !0
+
+fast:
+  %v = load i32, i32* %p
+  %r = add i32 %v, %x
+  ret i32 %r
+
+error:
+  call void @report(i32 %x)
+  call void @log(i32* %p)
+  %m = mul i32 %x, 3
+  call void @report(i32 %m)
+  call void @log(i32* %p)
+  store i32 0, i32* %p
+  br label %exit
+
+exit:
+  ret i32 -1
+}
+
+; CHECK-LABEL: define i32 @caller(
+; CHECK-NOT: call i32 @callee
+; CHECK: icmp sgt i32 %y, 0
+; CHECK: call void @callee{{.*}}_error(
+; CHECK: ret i32
+define i32 @caller(i32* %q, i32 %y) {
+  %c = call i32 @callee(i32* %q, i32 %y)
+  ret i32 %c
+}
+
+; CHECK: define internal void @callee{{.*}}_error({{.*}}) #[[ATTR:[0-9]+]]
+; CHECK: attributes #[[ATTR]] = { {{.*}}cold{{.*}}noinline{{.*}} }
+
+!0 = !{!"branch_weights", i32 1000, i32 1}
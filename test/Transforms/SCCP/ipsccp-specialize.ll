@@ -0,0 +1,69 @@
+; RUN: opt < %s -ipsccp -ipsccp-specialize-functions -S | FileCheck %s
+; RUN: opt < %s -ipsccp -ipsccp-specialize-functions -ipsccp-max-specializations=1 -S | FileCheck %s -check-prefix=ONE
+; RUN: opt < %s -ipsccp -ipsccp-specialize-functions -ipsccp-specialize-budget=5 -S | FileCheck %s -check-prefix=BUDGET
+; RUN: opt < %s -ipsccp -ipsccp-specialize-functions -pass-remarks=sccp -disable-output 2>&1 | FileCheck %s -check-prefix=REMARK
+;
+; @dispatch is called with two different modes, so plain IPSCCP can't fold its
+; switch. Specializing it for each mode lets each copy fold to a single case.
+
+; REMARK: specialized dispatch as dispatch.spec for 2 call site(s) passing arg 0=1
+; REMARK: specialized dispatch as dispatch.spec1 for 1 call site(s) passing arg 0=2
+
+define internal i32 @dispatch(i32 %mode, i32 %x) {
+entry:
+  switch i32 %mode, label %other [
+    i32 1, label %add
+    i32 2, label %mul
+  ]
+
+add:
+  %a = add i32 %x, 1
+  ret i32 %a
+
+mul:
+  %m = mul i32 %x, 3
+  ret i32 %m
+
+other:
+  ret i32 0
+}
+
+; CHECK-LABEL: define internal i32 @dispatch.spec(i32 %mode, i32 %x)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: br label %add
+; CHECK: add i32 %x, 1
+; CHECK-NOT: mul
+
+; CHECK-LABEL: define internal i32 @dispatch.spec1(i32 %mode, i32 %x)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: br label %mul
+; CHECK-NOT: add i32
+; CHECK: mul i32 %x, 3
+
+; CHECK-LABEL: define internal i32 @dispatch(i32 %mode, i32 %x)
+; CHECK: switch i32 %mode
+
+; ONE: define internal i32 @dispatch.spec(
+; ONE-NOT: define internal i32 @dispatch.spec1(
+
+; BUDGET-NOT: .spec
+
+define i32 @caller1(i32 %x) {
+; CHECK-LABEL: @caller1(
+; CHECK: call i32 @dispatch.spec(i32 1, i32 %x)
+; CHECK: call i32 @dispatch.spec(i32 1, i32 %x)
+  %r1 = call i32 @dispatch(i32 1, i32 %x)
+  %r2 = call i32 @dispatch(i32 1, i32 %x)
+  %r = add i32 %r1, %r2
+  ret i32 %r
+}
+
+define i32 @caller2(i32 %x, i32 %mode) {
+; CHECK-LABEL: @caller2(
+; CHECK: call i32 @dispatch.spec1(i32 2, i32 %x)
+; CHECK: call i32 @dispatch(i32 %mode, i32 %x)
+  %r1 = call i32 @dispatch(i32 2, i32 %x)
+  %r2 = call i32 @dispatch(i32 %mode, i32 %x)
+  %r = add i32 %r1, %r2
+  ret i32 %r
+}
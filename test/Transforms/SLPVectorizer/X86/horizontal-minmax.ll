@@ -0,0 +1,96 @@
+; RUN: opt -slp-vectorizer -slp-vectorize-hor -S < %s -mtriple=x86_64-unknown-linux -mcpu=corei7-avx | FileCheck %s
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+
+; A signed max over eight consecutive elements becomes two <4 x i32>
+; reductions of compares and selects.
+
+; CHECK-LABEL: @smax_v8(
+; CHECK: load <4 x i32>
+; CHECK: load <4 x i32>
+; CHECK: icmp sgt <4 x i32>
+; CHECK: select <4 x i1>
+; CHECK: extractelement <4 x i32>
+; CHECK: ret i32
+define i32 @smax_v8(i32* %p) {
+entry:
+  %p0 = getelementptr inbounds i32, i32* %p, i64 0
+  %l0 = load i32, i32* %p0, align 4
+  %p1 = getelementptr inbounds i32, i32* %p, i64 1
+  %l1 = load i32, i32* %p1, align 4
+  %p2 = getelementptr inbounds i32, i32* %p, i64 2
+  %l2 = load i32, i32* %p2, align 4
+  %p3 = getelementptr inbounds i32, i32* %p, i64 3
+  %l3 = load i32, i32* %p3, align 4
+  %p4 = getelementptr inbounds i32, i32* %p, i64 4
+  %l4 = load i32, i32* %p4, align 4
+  %p5 = getelementptr inbounds i32, i32* %p, i64 5
+  %l5 = load i32, i32* %p5, align 4
+  %p6 = getelementptr inbounds i32, i32* %p, i64 6
+  %l6 = load i32, i32* %p6, align 4
+  %p7 = getelementptr inbounds i32, i32* %p, i64 7
+  %l7 = load i32, i32* %p7, align 4
+  %c0 = icmp sgt i32 %l0, %l1
+  %m0 = select i1 %c0, i32 %l0, i32 %l1
+  %c1 = icmp sgt i32 %m0, %l2
+  %m1 = select i1 %c1, i32 %m0, i32 %l2
+  %c2 = icmp sgt i32 %m1, %l3
+  %m2 = select i1 %c2, i32 %m1, i32 %l3
+  %c3 = icmp sgt i32 %m2, %l4
+  %m3 = select i1 %c3, i32 %m2, i32 %l4
+  %c4 = icmp sgt i32 %m3, %l5
+  %m4 = select i1 %c4, i32 %m3, i32 %l5
+  %c5 = icmp sgt i32 %m4, %l6
+  %m5 = select i1 %c5, i32 %m4, i32 %l6
+  %c6 = icmp sgt i32 %m5, %l7
+  %m6 = select i1 %c6, i32 %m5, i32 %l7
+  ret i32 %m6
+}
+
+; The reduction tree spans two straight-line blocks; the loads of each
+; block are reduced in their own vector.
+
+; CHECK-LABEL: @umin_two_blocks(
+; CHECK: entry:
+; CHECK: load <4 x i32>
+; CHECK: next:
+; CHECK: load <4 x i32>
+; CHECK: icmp ult <4 x i32>
+; CHECK: ret i32
+define i32 @umin_two_blocks(i32* %p) {
+entry:
+  %ap0 = getelementptr inbounds i32, i32* %p, i64 0
+  %al0 = load i32, i32* %ap0, align 4
+  %ap1 = getelementptr inbounds i32, i32* %p, i64 1
+  %al1 = load i32, i32* %ap1, align 4
+  %ap2 = getelementptr inbounds i32, i32* %p, i64 2
+  %al2 = load i32, i32* %ap2, align 4
+  %ap3 = getelementptr inbounds i32, i32* %p, i64 3
+  %al3 = load i32, i32* %ap3, align 4
+  %ac0 = icmp ult i32 %al0, %al1
+  %am0 = select i1 %ac0, i32 %al0, i32 %al1
+  %ac1 = icmp ult i32 %am0, %al2
+  %am1 = select i1 %ac1, i32 %am0, i32 %al2
+  %ac2 = icmp ult i32 %am1, %al3
+  %am2 = select i1 %ac2, i32 %am1, i32 %al3
+  br label %next
+
+next:
+  %bp0 = getelementptr inbounds i32, i32* %p, i64 4
+  %bl0 = load i32, i32* %bp0, align 4
+  %bp1 = getelementptr inbounds i32, i32* %p, i64 5
+  %bl1 = load i32, i32* %bp1, align 4
+  %bp2 = getelementptr inbounds i32, i32* %p, i64 6
+  %bl2 = load i32, i32* %bp2, align 4
+  %bp3 = getelementptr inbounds i32, i32* %p, i64 7
+  %bl3 = load i32, i32* %bp3, align 4
+  %bc0 = icmp ult i32 %am2, %bl0
+  %bm0 = select i1 %bc0, i32 %am2, i32 %bl0
+  %bc1 = icmp ult i32 %bm0, %bl1
+  %bm1 = select i1 %bc1, i32 %bm0, i32 %bl1
+  %bc2 = icmp ult i32 %bm1, %bl2
+  %bm2 = select i1 %bc2, i32 %bm1, i32 %bl2
+  %bc3 = icmp ult i32 %bm2, %bl3
+  %bm3 = select i1 %bc3, i32 %bm2, i32 %bl3
+  ret i32 %bm3
+}
@@ -275,6 +275,39 @@ static Function &lookupFunction(Module &M, StringRef Name) {
   report_fatal_error("Couldn't find function!");
 }
 
+TEST(LazyCallGraphTest, SCCWavefronts) {
+  std::unique_ptr<Module> M = parseAssembly(DiamondOfTriangles);
+  LazyCallGraph CG(*M);
+
+  SmallVector<SmallVector<LazyCallGraph::SCC *, 4>, 4> Wavefronts;
+  CG.buildSCCWavefronts(Wavefronts);
+  ASSERT_EQ(3u, Wavefronts.size());
+
+  // The leaf SCC is alone in the first wavefront, the two arms of the diamond
+  // don't call each other and so share the second one, and the root SCC comes
+  // last.
+  ASSERT_EQ(1u, Wavefronts[0].size());
+  LazyCallGraph::SCC &D = *Wavefronts[0][0];
+  EXPECT_EQ(&D, CG.lookupSCC(*CG.lookup(lookupFunction(*M, "d1"))));
+
+  ASSERT_EQ(2u, Wavefronts[1].size());
+  LazyCallGraph::SCC &C = *Wavefronts[1][0];
+  LazyCallGraph::SCC &B = *Wavefronts[1][1];
+  EXPECT_EQ(&C, CG.lookupSCC(*CG.lookup(lookupFunction(*M, "c1"))));
+  EXPECT_EQ(&B, CG.lookupSCC(*CG.lookup(lookupFunction(*M, "b1"))));
+  EXPECT_FALSE(B.isAncestorOf(C));
+  EXPECT_FALSE(C.isAncestorOf(B));
+
+  ASSERT_EQ(1u, Wavefronts[2].size());
+  LazyCallGraph::SCC &A = *Wavefronts[2][0];
+  EXPECT_EQ(&A, CG.lookupSCC(*CG.lookup(lookupFunction(*M, "a1"))));
+  EXPECT_TRUE(A.isParentOf(B));
+  EXPECT_TRUE(A.isParentOf(C));
+
+  // Every SCC is placed in exactly one wavefront.
+  EXPECT_EQ(4, std::distance(CG.postorder_scc_begin(), CG.postorder_scc_end()));
+}
+
 TEST(LazyCallGraphTest, BasicGraphMutation) {
   std::unique_ptr<Module> M = parseAssembly(
       "define void @a() {\n"